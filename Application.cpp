@@ -27,16 +27,24 @@
 
 #include "Application.h"
 #include "Resources.h"
+#include "Settings.h"
 #include "constant.h"
 #include "XTools.h"
 #include "DBus.h"
 
 #include "Image.h"
+#include "DesktopCache.h"
+#include "IconIndex.h"
 
 int Application::_pixmapWidth = 104;
 int Application::_pixmapHeight = 96;
 XftFont * Application::_xftFont = 0;
 
+Vector<Application*> Application::_imageCache;
+unsigned int Application::_frame = 0;
+Application::ImageChangedCallback Application::_imageChangedCallback = 0;
+void * Application::_imageChangedCallbackData = 0;
+
 Application::Application(Display *dpy, const gchar *filename)
 {
     _dpy = dpy;
@@ -45,7 +53,13 @@ Application::Application(Display *dpy, const gchar *filename)
     _iconPath = 0;
     _executable = 0;
     _service = 0;
+    _appName = 0;
+    _runInTerminal = FALSE;
     _image = 0;
+    _iconRequest = 0;
+    _usedFrame = 0;
+    _prefetched = false;
+    _prefetchFrame = 0;
 
     GKeyFile* keyFile = g_key_file_new();
     gchar *group;
@@ -68,50 +82,32 @@ Application::Application(Display *dpy, const gchar *filename)
         if ( _isValid )
         {
             // get icon path and filename
-            _iconPath = g_key_file_get_string ( keyFile, group, "X-Icon-path", NULL);
-            _icon = g_strconcat(g_key_file_get_string ( keyFile, group, "Icon", NULL), ".png", NULL);
-            bool useDefaultIcon = TRUE;
-            if (_icon != NULL)
-        {
-                if ( g_file_test ( g_strconcat ( ICON_PATH, "scalable/hildon/", _icon, NULL ), G_FILE_TEST_EXISTS ) )
-                {
-                    useDefaultIcon = FALSE;
-                    _iconPath = g_strconcat ( ICON_PATH, "scalable/hildon/", NULL );
-                }
-                else if ( _iconPath != NULL && g_file_test ( g_strconcat ( _iconPath, _icon, NULL ), G_FILE_TEST_EXISTS ) )
-                {
-                    useDefaultIcon = FALSE;
-                }
-                else if ( g_file_test ( g_strconcat ( ICON_PATH, "64x64/apps/", _icon, NULL ), G_FILE_TEST_EXISTS ) )
-                {
-                    useDefaultIcon = FALSE;
-                    _iconPath = g_strconcat ( ICON_PATH, "64x64/apps/", NULL );
-                }
-                else if ( g_file_test ( g_strconcat ( ICON_PATH, "64x64/hildon/", _icon, NULL ), G_FILE_TEST_EXISTS ) )
-                {
-                    useDefaultIcon = FALSE;
-                    _iconPath = g_strconcat ( ICON_PATH, "64x64/hildon/", NULL );
-                }
-                else if ( g_file_test ( g_strconcat ( ICON_PATH, "scalable/apps/" , _icon, NULL), G_FILE_TEST_EXISTS ) )
-                {
-                    useDefaultIcon = FALSE;
-                    _iconPath = g_strconcat ( ICON_PATH, "scalable/apps/", NULL );
-                }
-                else if ( g_file_test ( g_strconcat ( "/usr/share/pixmaps/", _icon, NULL), G_FILE_TEST_EXISTS ) )
-                {
-                    useDefaultIcon = FALSE;
-                    _iconPath = g_strdup ( "/usr/share/pixmaps/" );
-                }
+            gchar *customPath = g_key_file_get_string ( keyFile, group, "X-Icon-path", NULL );
+            gchar *iconName = g_key_file_get_string ( keyFile, group, "Icon", NULL );
+
+            if ( iconName != NULL )
+            {
+                _icon = g_strconcat ( iconName, ".png", NULL );
+
+                const gchar *iconPath = IconIndex::instance()->lookup ( _icon, customPath );
+                if ( iconPath != NULL )
+                    _iconPath = g_strdup ( iconPath );
             }
 
-            if ( useDefaultIcon )
+            if ( _iconPath == NULL )
             {
+                g_free ( _icon );
                 _iconPath = g_strconcat ( ICON_PATH, "scalable/hildon/", NULL );
                 _icon = g_strdup ( "qgn_list_gene_default_app.png" );
             }
 
+            g_free ( iconName );
+            g_free ( customPath );
+
             // get the application name;
-            _appName = gettext( g_key_file_get_string ( keyFile, group, "Name", NULL ) );
+            gchar *name = g_key_file_get_string ( keyFile, group, "Name", NULL );
+            _appName = g_strdup ( name != NULL ? gettext ( name ) : "" );
+            g_free ( name );
 
             _executable = g_key_file_get_string ( keyFile, group, "Exec", NULL );
 
@@ -139,15 +135,34 @@ Application::Application(Display *dpy, const gchar *filename)
     }
 
     g_key_file_free ( keyFile );
+}
 
-    if (_isValid)
-        createPicture();
+Application::Application(Display *dpy, const DesktopEntry *entry)
+{
+    _dpy = dpy;
+    _image = 0;
+    _iconRequest = 0;
+    _usedFrame = 0;
+    _prefetched = false;
+    _prefetchFrame = 0;
+
+    _filename = g_strconcat ( DESKTOP_FILE_PATH, entry->filename, NULL );
+    _isValid = entry->valid;
+    _runInTerminal = entry->runInTerminal;
+    _appName = g_strdup ( entry->name );
+    _executable = g_strdup ( entry->executable );
+    _service = g_strdup ( entry->service );
+    _icon = g_strdup ( entry->icon );
+    _iconPath = g_strdup ( entry->iconPath );
 }
 
 Application::~Application()
 {
     g_log(G_LOG_DOMAIN, G_LOG_LEVEL_INFO, "Application dtor");
 
+    releaseImage();
+    dropPrefetch();
+
     if ( _filename != NULL )
         g_free ( _filename );
 
@@ -163,6 +178,9 @@ Application::~Application()
     if ( _service != NULL )
         g_free ( _service );
 
+    if ( _appName != NULL )
+        g_free ( _appName );
+
     if ( _xftFont )
     {
         XftFontClose( _dpy, _xftFont );
@@ -268,12 +286,121 @@ bool Application::isValid()
     return _isValid;
 }
 
+void Application::describe(DesktopEntry *entry)
+{
+    entry->valid = _isValid;
+    entry->runInTerminal = _runInTerminal;
+    entry->name = _appName;
+    entry->executable = _executable;
+    entry->service = _service;
+    entry->icon = _icon;
+    entry->iconPath = _iconPath;
+}
+
 void Application::setPosition ( int x, int y )
 {
     _x = x;
     _y = y;
 }
 
+Image* Application::image()
+{
+    if ( _image == NULL )
+    {
+        createPicture();
+        _imageCache.prepend ( this );
+    }
+    else if ( _imageCache.head() && *_imageCache.head() != this )
+    {
+        _imageCache.removeByValue ( this );
+        _imageCache.prepend ( this );
+    }
+
+    _usedFrame = _frame;
+
+    return _image;
+}
+
+void Application::releaseImage()
+{
+    if ( _iconRequest != NULL )
+    {
+        ImageLoader::instance()->cancel ( _iconRequest );
+        _iconRequest = 0;
+    }
+
+    if ( _image != NULL )
+    {
+        delete _image;
+        _image = 0;
+        _imageCache.removeByValue ( this );
+    }
+}
+
+void Application::prefetchIcon()
+{
+    if ( _image != NULL || ! _isValid )
+        return;
+
+    _prefetchFrame = _frame;
+    if ( _prefetched )
+        return;
+
+    gchar *filename = g_strconcat ( _iconPath, _icon, NULL );
+    ImageLoader::instance()->prefetch ( filename );
+    g_free ( filename );
+
+    _prefetched = true;
+}
+
+void Application::cancelPrefetch()
+{
+    // Application is in a neighbour section as well
+    if ( _prefetchFrame == _frame )
+        return;
+
+    dropPrefetch();
+}
+
+void Application::dropPrefetch()
+{
+    if ( ! _prefetched )
+        return;
+
+    gchar *filename = g_strconcat ( _iconPath, _icon, NULL );
+    ImageLoader::instance()->cancelPrefetch ( filename );
+    g_free ( filename );
+
+    _prefetched = false;
+}
+
+void Application::trimImages()
+{
+    int tileSize = _pixmapWidth * _pixmapHeight * 4;
+    int limit = Settings::instance()->launcherTilesCacheSize() * 1024 / tileSize;
+
+    int count = _imageCache.size();
+    for ( Vector<Application*>::Iter i = _imageCache.tail(); i && count > limit; --i )
+    {
+        Application *app = *i;
+
+        // Section page would never get the icon otherwise
+        if ( app->_usedFrame == _frame || app->_iconRequest != NULL )
+            continue;
+
+        app->releaseImage();
+        count--;
+    }
+
+    _frame++;
+}
+
+void Application::setImageChangedCallback(ImageChangedCallback callback, void *data)
+{
+    _imageChangedCallback = callback;
+    _imageChangedCallbackData = data;
+}
+
 //Picture Application::draw(Display *dpy)
 void Application::createPicture()
 {
@@ -282,30 +409,12 @@ void Application::createPicture()
 
     Resources * resources = Resources::instance();
 
-    // draw a transparent canvas
-
-    // Load icon and draw icon
-
+    // Load icon, it is drawn by onIconLoaded()
     gchar *filename = g_strconcat(_iconPath, _icon, NULL);
-    Image* icon = new Image(_dpy, filename);
+    _iconRequest = ImageLoader::instance()->load(filename, Delegate(this, &Application::onIconLoaded));
+    _prefetched = false;
     g_free(filename);
 
-    if (! icon->valid())
-        printf ( "Cannot load icon: %s%s\n", _iconPath, _icon );
-    else
-    {
-        XRenderComposite(
-            _dpy, PictOpSrc,
-            icon->picture(), None, _image->picture(),
-            0, 0,
-            0, 0,
-            (_image->width() - icon->width()) / 2, // x pos
-            (64 - icon->width()) / 2, // y pos
-            icon->width(), // width
-            icon->height() // height
-        );
-    }
-
     // Load and draw text background
     XRenderComposite(
         _dpy, PictOpSrc,
@@ -367,8 +476,32 @@ void Application::createPicture()
     XDestroyRegion ( clip );
 
     // free resources
-    delete icon;
-
     XftDrawDestroy ( xftDraw );
 }
 
+void Application::onIconLoaded(Image *icon)
+{
+    _iconRequest = 0;
+
+    if (! icon->valid())
+        printf ( "Cannot load icon: %s%s\n", _iconPath, _icon );
+    else
+    {
+        XRenderComposite(
+            _dpy, PictOpSrc,
+            icon->picture(), None, _image->picture(),
+            0, 0,
+            0, 0,
+            (_image->width() - icon->width()) / 2, // x pos
+            (64 - icon->width()) / 2, // y pos
+            icon->width(), // width
+            icon->height() // height
+        );
+
+        if (_imageChangedCallback)
+            _imageChangedCallback(this, _imageChangedCallbackData);
+    }
+
+    delete icon;
+}
+
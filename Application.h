@@ -28,16 +28,22 @@
 
 #include <glib.h>
 
+#include "ImageLoader.h"
+#include "Vector.h"
+
 class Image;
+struct DesktopEntry;
 
 
 class Application
 {
 public:
     Application(Display *dpy, const gchar *filename);
+    Application(Display *dpy, const DesktopEntry *entry);
     ~Application();
     const gchar* getIcon();
     const gchar* getApplicationName();
+    const gchar* getExecutable() { return _executable; }
     bool execute();
     bool isValid();
     void setPosition(int x, int y);
@@ -49,7 +55,28 @@ public:
     static int width() { return _pixmapWidth; }
     static int height() { return _pixmapHeight; }
 
-    Image* image() { return _image; }
+    // Tile is rendered on first use and may be dropped by trimImages()
+    Image* image();
+    void releaseImage();
+
+    // Starts decoding of the icon so that image() finds it ready
+    void prefetchIcon();
+
+    // Frees icon decoded by prefetchIcon() if the tile was not rendered,
+    // unless it was prefetched again since the last trimImages()
+    void cancelPrefetch();
+
+    // Drops least recently used tiles above launcher.tiles.cachesize,
+    // except ones used since previous call and ones still waiting for
+    // their icons. Called after each paint.
+    static void trimImages();
+
+    // Called when icon is drawn onto already rendered tile
+    typedef void (*ImageChangedCallback)(Application *app, void *data);
+    static void setImageChangedCallback(ImageChangedCallback callback, void *data);
+
+    // Fills everything but filename and mtime, strings are not copied
+    void describe(DesktopEntry *entry);
 
 private:
     gchar * _filename;
@@ -75,6 +102,23 @@ private:
 
     Image* _image;
     void createPicture();
+
+    // Applications with tiles, most recently used first
+    static Vector<Application*> _imageCache;
+    static unsigned int _frame;
+    unsigned int _usedFrame;
+
+    static ImageChangedCallback _imageChangedCallback;
+    static void *_imageChangedCallbackData;
+
+    // Icon is decoded in background and drawn when ready
+    ImageLoader::Request *_iconRequest;
+    void onIconLoaded(Image *icon);
+
+    // Icon is prefetched and not picked up by createPicture() yet
+    bool _prefetched;
+    unsigned int _prefetchFrame;
+    void dropPrefetch();
 };
 
 #endif // APPLICATION_H
@@ -26,6 +26,7 @@ DBus::DBus(XEventLoop *eventLoop, TeleWindow *teleWindow)
 {
     _instance = this;
 
+    _eventLoop = eventLoop;
     _teleWindow = teleWindow;
 
     #ifdef LAUNCHER
@@ -135,6 +136,18 @@ DBusHandlerResult DBus::telescope_message(
 
         self->_teleWindow->hide();
     }
+    else if (dbus_message_is_method_call(msg, "org.telescope.Telescope", "RoundTrips"))
+    {
+        // Number of blocking X requests during last second
+        dbus_uint32_t roundTrips = self->_eventLoop->roundTripsPerSecond();
+
+        DBusMessage *reply = dbus_message_new_method_return(msg);
+        dbus_message_append_args(reply,
+            DBUS_TYPE_UINT32, &roundTrips,
+            DBUS_TYPE_INVALID);
+        dbus_connection_send(conn, reply, 0);
+        dbus_message_unref(reply);
+    }
 
     XFlush(self->_teleWindow->display());
 
@@ -0,0 +1,326 @@
+/*
+ *  Copyright (c) 2010 Andry Gunawan <angun33@gmail.com>
+ *
+ *  Parts of this file are based on Telescope which is
+ *  Copyright (c) 2010 Ilya Skriblovsky <Ilya.Skriblovsky@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "DesktopCache.h"
+#include "constant.h"
+#include "IconIndex.h"
+
+// Bump on any change of the structures below
+#define CACHE_MAGIC     "TLDC"
+#define CACHE_VERSION   1
+
+#define FLAG_VALID      1
+#define FLAG_TERMINAL   2
+
+#define NUM_ICON_DIRS   IconIndex::DIR_COUNT
+
+// File layout: header, records sorted by filename, string table.
+// Strings are referenced by offsets into the table, offset 0 is NULL.
+struct CacheHeader
+{
+    char magic[4];
+    guint32 version;
+    guint32 count;
+    guint32 stringsSize;
+    gint64 iconDirMtimes[NUM_ICON_DIRS];
+    char locale[32];
+};
+
+struct CacheRecord
+{
+    gint64 mtime;
+    guint32 flags;
+    guint32 filename;
+    guint32 name;
+    guint32 executable;
+    guint32 service;
+    guint32 icon;
+    guint32 iconPath;
+};
+
+static time_t fileMtime(const char *path)
+{
+    struct stat st;
+    return stat ( path, &st ) == 0 ? st.st_mtime : 0;
+}
+
+// Fills header fields which must match for the cache to be valid
+static void fillHeader(CacheHeader *header)
+{
+    memset ( header, 0, sizeof ( CacheHeader ) );
+    memcpy ( header->magic, CACHE_MAGIC, 4 );
+    header->version = CACHE_VERSION;
+
+    for ( guint i = 0; i < NUM_ICON_DIRS; i++ )
+        header->iconDirMtimes[i] = fileMtime ( IconIndex::dir ( i ) );
+
+    // Names are translated while parsing
+    const char *locale = setlocale ( LC_MESSAGES, NULL );
+    if ( locale != NULL )
+        strncpy ( header->locale, locale, sizeof ( header->locale ) - 1 );
+}
+
+static int compareEntries(gconstpointer a, gconstpointer b)
+{
+    const DesktopEntry *ea = *( const DesktopEntry * const * ) a;
+    const DesktopEntry *eb = *( const DesktopEntry * const * ) b;
+    return strcmp ( ea->filename, eb->filename );
+}
+
+static void freeEntry(DesktopEntry *entry)
+{
+    g_free ( ( gchar * ) entry->filename );
+    g_free ( ( gchar * ) entry->name );
+    g_free ( ( gchar * ) entry->executable );
+    g_free ( ( gchar * ) entry->service );
+    g_free ( ( gchar * ) entry->icon );
+    g_free ( ( gchar * ) entry->iconPath );
+    delete entry;
+}
+
+// Appends string to the table and returns its offset
+static guint32 addString(GString *strings, const gchar *str)
+{
+    if ( str == NULL )
+        return 0;
+
+    guint32 offset = strings->len;
+    g_string_append_len ( strings, str, strlen ( str ) + 1 );
+    return offset;
+}
+
+
+DesktopCache::DesktopCache()
+{
+    _data = NULL;
+    _size = 0;
+    _count = 0;
+    _pending = g_ptr_array_new();
+}
+
+DesktopCache::~DesktopCache()
+{
+    _unmap();
+
+    for ( guint i = 0; i < _pending->len; i++ )
+        freeEntry ( ( DesktopEntry * ) g_ptr_array_index ( _pending, i ) );
+    g_ptr_array_free ( _pending, TRUE );
+}
+
+void DesktopCache::_unmap()
+{
+    if ( _data != NULL )
+        munmap ( _data, _size );
+
+    _data = NULL;
+    _size = 0;
+    _count = 0;
+}
+
+void DesktopCache::load()
+{
+    _unmap();
+
+    int fd = open ( DESKTOP_CACHE, O_RDONLY );
+    if ( fd < 0 )
+        return;
+
+    struct stat st;
+    if ( fstat ( fd, &st ) < 0 || st.st_size < ( off_t ) sizeof ( CacheHeader ) )
+    {
+        close ( fd );
+        return;
+    }
+
+    void *data = mmap ( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close ( fd );
+
+    if ( data == MAP_FAILED )
+        return;
+
+    _data = ( gchar * ) data;
+    _size = st.st_size;
+
+    const CacheHeader *header = ( const CacheHeader * ) _data;
+
+    CacheHeader expected;
+    fillHeader ( &expected );
+
+    bool valid =
+        memcmp ( header->magic, expected.magic, 4 ) == 0 &&
+        header->version == expected.version &&
+        memcmp ( header->iconDirMtimes, expected.iconDirMtimes, sizeof ( expected.iconDirMtimes ) ) == 0 &&
+        strncmp ( header->locale, expected.locale, sizeof ( expected.locale ) ) == 0 &&
+        // String table must fit and end with NUL, so that no string
+        // may run out of the mapping
+        header->stringsSize > 0 &&
+        sizeof ( CacheHeader ) + ( gsize ) header->count * sizeof ( CacheRecord ) + header->stringsSize == _size &&
+        _data[_size - 1] == '\0';
+
+    if ( ! valid )
+    {
+        printf ( "Desktop cache is stale, it will be rebuilt\n" );
+        _unmap();
+        return;
+    }
+
+    _count = header->count;
+}
+
+bool DesktopCache::lookup(const gchar *filename, time_t mtime, DesktopEntry *entry)
+{
+    if ( _data == NULL )
+        return false;
+
+    const CacheRecord *records = ( const CacheRecord * ) ( _data + sizeof ( CacheHeader ) );
+    const gchar *strings = ( const gchar * ) ( records + _count );
+    gsize stringsSize = _size - ( strings - _data );
+
+    // Records are sorted by filename
+    guint low = 0, high = _count;
+    while ( low < high )
+    {
+        guint middle = ( low + high ) / 2;
+        const CacheRecord *record = &records[middle];
+
+        if ( record->filename >= stringsSize )
+            return false;
+
+        int cmp = strcmp ( strings + record->filename, filename );
+        if ( cmp < 0 )
+            low = middle + 1;
+        else if ( cmp > 0 )
+            high = middle;
+        else
+        {
+            if ( ( time_t ) record->mtime != mtime )
+                return false;
+
+            guint32 offsets[] = {
+                record->name, record->executable, record->service, record->icon, record->iconPath
+            };
+            for ( guint i = 0; i < sizeof ( offsets ) / sizeof ( offsets[0] ); i++ )
+                if ( offsets[i] >= stringsSize )
+                    return false;
+
+            entry->filename = strings + record->filename;
+            entry->mtime = mtime;
+            entry->valid = ( record->flags & FLAG_VALID ) != 0;
+            entry->runInTerminal = ( record->flags & FLAG_TERMINAL ) != 0;
+            entry->name = record->name ? strings + record->name : NULL;
+            entry->executable = record->executable ? strings + record->executable : NULL;
+            entry->service = record->service ? strings + record->service : NULL;
+            entry->icon = record->icon ? strings + record->icon : NULL;
+            entry->iconPath = record->iconPath ? strings + record->iconPath : NULL;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DesktopCache::add(const DesktopEntry *entry)
+{
+    DesktopEntry *copy = new DesktopEntry;
+    copy->filename = g_strdup ( entry->filename );
+    copy->mtime = entry->mtime;
+    copy->valid = entry->valid;
+    copy->runInTerminal = entry->runInTerminal;
+    copy->name = g_strdup ( entry->name );
+    copy->executable = g_strdup ( entry->executable );
+    copy->service = g_strdup ( entry->service );
+    copy->icon = g_strdup ( entry->icon );
+    copy->iconPath = g_strdup ( entry->iconPath );
+
+    g_ptr_array_add ( _pending, copy );
+}
+
+void DesktopCache::save()
+{
+    g_ptr_array_sort ( _pending, compareEntries );
+
+    CacheHeader header;
+    fillHeader ( &header );
+    header.count = _pending->len;
+
+    CacheRecord *records = new CacheRecord[_pending->len];
+    GString *strings = g_string_new ( "" );
+    // Offset 0 stands for NULL
+    g_string_append_c ( strings, '\0' );
+
+    for ( guint i = 0; i < _pending->len; i++ )
+    {
+        DesktopEntry *entry = ( DesktopEntry * ) g_ptr_array_index ( _pending, i );
+        CacheRecord *record = &records[i];
+
+        memset ( record, 0, sizeof ( CacheRecord ) );
+        record->mtime = entry->mtime;
+        record->flags = ( entry->valid ? FLAG_VALID : 0 ) | ( entry->runInTerminal ? FLAG_TERMINAL : 0 );
+        record->filename = addString ( strings, entry->filename );
+        record->name = addString ( strings, entry->name );
+        record->executable = addString ( strings, entry->executable );
+        record->service = addString ( strings, entry->service );
+        record->icon = addString ( strings, entry->icon );
+        record->iconPath = addString ( strings, entry->iconPath );
+
+        freeEntry ( entry );
+    }
+    g_ptr_array_set_size ( _pending, 0 );
+
+    header.stringsSize = strings->len;
+
+    // Writing to temporary file and renaming it over the old one, so
+    // that mapped cache is never seen half-written
+    gchar *tmpName = g_strconcat ( DESKTOP_CACHE, ".tmp", NULL );
+    FILE *f = fopen ( tmpName, "w" );
+    if ( f == NULL )
+        fprintf ( stderr, "Could not open %s for writing!\n", tmpName );
+    else
+    {
+        bool ok =
+            fwrite ( &header, sizeof ( header ), 1, f ) == 1 &&
+            ( header.count == 0 || fwrite ( records, sizeof ( CacheRecord ), header.count, f ) == header.count ) &&
+            fwrite ( strings->str, strings->len, 1, f ) == 1;
+
+        if ( fclose ( f ) != 0 )
+            ok = false;
+
+        if ( ok && rename ( tmpName, DESKTOP_CACHE ) == 0 )
+            load();
+        else
+        {
+            fprintf ( stderr, "Could not write %s\n", DESKTOP_CACHE );
+            unlink ( tmpName );
+        }
+    }
+
+    g_free ( tmpName );
+    g_string_free ( strings, TRUE );
+    delete[] records;
+}
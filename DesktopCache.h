@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2010 Andry Gunawan <angun33@gmail.com>
+ *
+ *  Parts of this file are based on Telescope which is
+ *  Copyright (c) 2010 Ilya Skriblovsky <Ilya.Skriblovsky@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DESKTOPCACHE_H
+#define DESKTOPCACHE_H
+
+#include <time.h>
+#include <glib.h>
+
+// Parsed contents of a .desktop file with resolved icon path.
+// Strings are not owned by the entry.
+struct DesktopEntry
+{
+    const gchar *filename;      // relative to DESKTOP_FILE_PATH
+    time_t mtime;
+    bool valid;
+    bool runInTerminal;
+    const gchar *name;
+    const gchar *executable;
+    const gchar *service;
+    const gchar *icon;
+    const gchar *iconPath;
+};
+
+// On-disk cache of DesktopEntry records, so that warm startup neither
+// parses .desktop files nor probes icon directories.
+//
+// The file is mapped read-only and looked up in place. Every record
+// remembers the mtime of its .desktop file, the header remembers mtimes of
+// the standard icon directories and the locale used for names. Cache of
+// other version, locale or with changed icon directories is ignored and
+// rewritten by the next save().
+class DesktopCache
+{
+public:
+    DesktopCache();
+    ~DesktopCache();
+
+    // Maps the cache file, if it exists and is still valid
+    void load();
+
+    // Fills entry from the cache if it has a record for the file with
+    // the same mtime. Strings point into the mapped file and are valid
+    // until the next load().
+    bool lookup(const gchar *filename, time_t mtime, DesktopEntry *entry);
+
+    // Number of records in the mapped file
+    guint size() { return _count; }
+
+    // Collects entries for save(), strings are copied
+    void add(const DesktopEntry *entry);
+
+    // Replaces the cache file with added entries and maps it again
+    void save();
+
+private:
+    void _unmap();
+
+    gchar *_data;
+    gsize _size;
+    guint _count;
+
+    GPtrArray *_pending;
+};
+
+#endif // DESKTOPCACHE_H
@@ -0,0 +1,218 @@
+/**
+ * @file HashMap.h
+ *
+ * @brief Header and implementation of HashMap<K, V>
+ *
+ * HashMap<K, V> is implemented as template and fully defined in this
+ * header file
+ *
+ * $Id$
+ *
+ */
+
+#ifndef __HASH_MAP_H
+#define __HASH_MAP_H
+
+#include <assert.h>
+
+
+/// Hash function used by HashMap
+/**
+ * Default implementation is suitable for integer-like keys (XIDs,
+ * pointers casted to integers etc). Specialize it for other key types.
+ */
+template <class K>
+inline unsigned int hashKey(const K& key)
+{
+    // Multiplicative mix of the XID. Table takes low bits of the result,
+    // which depend only on low bits of h, so high bits are folded in
+    // first. Odd multiplier keeps sequentially allocated XIDs apart
+    unsigned long h = (unsigned long)key;
+    h ^= h >> 16;
+    return (unsigned int)(h * 2654435761u);
+}
+
+
+/// Implements hash map from keys of type K to values of type V
+/**
+ * Open addressing with linear probing. Deletion shifts following entries
+ * back, so there are no "deleted" markers and lookups stay short.
+ *
+ * Keys and values are stored by value.
+ *
+ * @warning K and V must have default constructors and assignment operators
+ */
+template <class K, class V>
+class HashMap
+{
+    private:
+        /// Single slot of the table
+        struct Slot
+        {
+            bool used;  ///< Whether slot contains an entry
+            K key;      ///< Key of the entry
+            V value;    ///< Value of the entry
+        };
+
+        Slot *m_slots;  ///< Table of 2^n slots
+        int m_capacity; ///< Number of slots, always power of two
+        int m_size;     ///< Number of used slots
+
+        /// Returns index of slot containing key or of empty slot where it
+        /// should be placed
+        int findSlot(const K& key) const
+        {
+            int mask = m_capacity - 1;
+            int index = hashKey(key) & mask;
+
+            while (m_slots[index].used && !(m_slots[index].key == key))
+                index = (index + 1) & mask;
+
+            return index;
+        }
+
+        /// Reallocates table with given number of slots
+        void rehash(int capacity)
+        {
+            Slot *oldSlots = m_slots;
+            int oldCapacity = m_capacity;
+
+            m_slots = new Slot[capacity];
+            m_capacity = capacity;
+            for (int i = 0; i < m_capacity; ++i)
+                m_slots[i].used = false;
+
+            for (int i = 0; i < oldCapacity; ++i)
+                if (oldSlots[i].used)
+                {
+                    Slot &slot = m_slots[findSlot(oldSlots[i].key)];
+                    slot.used = true;
+                    slot.key = oldSlots[i].key;
+                    slot.value = oldSlots[i].value;
+                }
+
+            delete[] oldSlots;
+        }
+
+        // Copying is not needed by now
+        HashMap(const HashMap<K, V>&);
+        HashMap<K, V>& operator = (const HashMap<K, V>&);
+
+    public:
+        /// Creates an empty hash map
+        HashMap()
+        {
+            m_slots = 0;
+            m_capacity = 0;
+            m_size = 0;
+            rehash(16);
+        }
+
+        /// Deletes the hash map
+        ~HashMap()
+        {
+            delete[] m_slots;
+        }
+
+        /// Returns current number of entries
+        int size() const
+        { return m_size; }
+
+        /// Inserts new entry or replaces value of existing one
+        void insert(const K& key, const V& value)
+        {
+            // Keeping load factor below 3/4
+            if ((m_size + 1) * 4 > m_capacity * 3)
+                rehash(m_capacity * 2);
+
+            Slot &slot = m_slots[findSlot(key)];
+            if (! slot.used)
+            {
+                slot.used = true;
+                slot.key = key;
+                m_size++;
+            }
+            slot.value = value;
+        }
+
+        /// Removes entry with given key, if any
+        void remove(const K& key)
+        {
+            int mask = m_capacity - 1;
+            int hole = findSlot(key);
+            if (! m_slots[hole].used)
+                return;
+
+            // Moving back entries which would not be found otherwise
+            int index = hole;
+            while (true)
+            {
+                index = (index + 1) & mask;
+                if (! m_slots[index].used)
+                    break;
+
+                int home = hashKey(m_slots[index].key) & mask;
+                // Entry may stay if its home slot is cyclically in (hole, index]
+                bool stays = hole <= index ?
+                    (hole < home && home <= index) :
+                    (hole < home || home <= index);
+                if (stays)
+                    continue;
+
+                m_slots[hole].key = m_slots[index].key;
+                m_slots[hole].value = m_slots[index].value;
+                hole = index;
+            }
+
+            m_slots[hole].used = false;
+            m_slots[hole].key = K();
+            m_slots[hole].value = V();
+            m_size--;
+        }
+
+        /// Removes all entries
+        void clear()
+        {
+            for (int i = 0; i < m_capacity; ++i)
+            {
+                m_slots[i].used = false;
+                m_slots[i].key = K();
+                m_slots[i].value = V();
+            }
+            m_size = 0;
+        }
+
+        /// Returns pointer to value for given key
+        /**
+         * @return Pointer to value stored in the map or NULL if there is no
+         *         such key. Pointer is valid until next insert() or remove()
+         */
+        V* find(const K& key)
+        {
+            Slot &slot = m_slots[findSlot(key)];
+            return slot.used ? &slot.value : 0;
+        }
+
+        /// Returns pointer to value for given key
+        const V* find(const K& key) const
+        {
+            const Slot &slot = m_slots[findSlot(key)];
+            return slot.used ? &slot.value : 0;
+        }
+
+        /// Checks whether the map contains given key
+        bool contains(const K& key) const
+        {
+            return m_slots[findSlot(key)].used;
+        }
+
+        /// Returns value for given key or \c def if there is no such key
+        V value(const K& key, const V& def = V()) const
+        {
+            const Slot &slot = m_slots[findSlot(key)];
+            return slot.used ? slot.value : def;
+        }
+};
+
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ *  Copyright (c) 2010 Andry Gunawan <angun33@gmail.com>
+ *
+ *  Parts of this file are based on Telescope which is
+ *  Copyright (c) 2010 Ilya Skriblovsky <Ilya.Skriblovsky@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+
+#include "IconIndex.h"
+#include "constant.h"
+#include "XEventLoop.h"
+
+#define EVENT_SIZE  ( sizeof (struct inotify_event) )
+#define BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
+
+static const gchar * const iconDirs[IconIndex::DIR_COUNT] =
+{
+    ICON_PATH "scalable/hildon/",
+    ICON_PATH "64x64/apps/",
+    ICON_PATH "64x64/hildon/",
+    ICON_PATH "scalable/apps/",
+    "/usr/share/pixmaps/"
+};
+
+#define NUM_ICON_DIRS   IconIndex::DIR_COUNT
+
+IconIndex * IconIndex::_instance = NULL;
+
+const gchar * IconIndex::dir(guint dirNo)
+{
+    return iconDirs[dirNo];
+}
+
+IconIndex::IconIndex()
+{
+    _instance = this;
+
+    _icons = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+
+    _wds = new int[NUM_ICON_DIRS];
+    for ( guint i = 0; i < NUM_ICON_DIRS; i++ )
+        _wds[i] = -1;
+
+    _fd = inotify_init();
+    if ( _fd < 0 )
+        printf ( "error inotify_init\n" );
+    else
+    {
+        for ( guint i = 0; i < NUM_ICON_DIRS; i++ )
+            _wds[i] = inotify_add_watch ( _fd, iconDirs[i], IN_CREATE | IN_DELETE | IN_MOVE );
+
+        fcntl( _fd, F_SETFL, O_NONBLOCK );
+        fcntl( _fd, F_SETFD, FD_CLOEXEC );
+        XEventLoop::instance()->addFdWatch( _fd, Delegate( this, &IconIndex::onInotify ) );
+    }
+
+    // Watches are set before scanning, so no file can be missed
+    for ( guint i = 0; i < NUM_ICON_DIRS; i++ )
+        _scan ( i );
+}
+
+IconIndex::~IconIndex()
+{
+    if ( _fd >= 0 )
+    {
+        XEventLoop::instance()->removeFdWatch( _fd );
+        ( void ) close( _fd );
+    }
+
+    delete[] _wds;
+    g_hash_table_destroy ( _icons );
+
+    _instance = NULL;
+}
+
+void IconIndex::_setPresent(const gchar *icon, guint dirNo, bool present)
+{
+    guint mask = GPOINTER_TO_UINT ( g_hash_table_lookup ( _icons, icon ) );
+
+    if ( present )
+        mask |= 1 << dirNo;
+    else
+        mask &= ~( 1 << dirNo );
+
+    if ( mask != 0 )
+        g_hash_table_replace ( _icons, g_strdup ( icon ), GUINT_TO_POINTER ( mask ) );
+    else
+        g_hash_table_remove ( _icons, icon );
+}
+
+void IconIndex::_scan(guint dirNo)
+{
+    DIR *dp = opendir ( iconDirs[dirNo] );
+    if ( dp == NULL )
+        return;
+
+    struct dirent *ep;
+    while ( ( ep = readdir ( dp ) ) )
+    {
+        if ( ep->d_name[0] != '.' )
+            _setPresent ( ep->d_name, dirNo, true );
+    }
+
+    ( void ) closedir ( dp );
+}
+
+const gchar * IconIndex::lookup(const gchar *icon, const gchar *customPath)
+{
+    guint mask = GPOINTER_TO_UINT ( g_hash_table_lookup ( _icons, icon ) );
+
+    if ( mask & 1 )
+        return iconDirs[0];
+
+    // Application's own directory is not indexed, probing it directly
+    if ( customPath != NULL )
+    {
+        gchar *filename = g_strconcat ( customPath, icon, NULL );
+        bool exists = g_file_test ( filename, G_FILE_TEST_EXISTS );
+        g_free ( filename );
+
+        if ( exists )
+            return customPath;
+    }
+
+    for ( guint i = 1; i < NUM_ICON_DIRS; i++ )
+    {
+        if ( mask & ( 1 << i ) )
+            return iconDirs[i];
+    }
+
+    return NULL;
+}
+
+void IconIndex::onInotify(int fd)
+{
+    bool overflow = false;
+
+    char buffer[BUF_LEN];
+    int length;
+    while ( ( length = read( fd, buffer, BUF_LEN ) ) > 0 )
+    {
+        int i = 0;
+        while ( i < length )
+        {
+            struct inotify_event *event = ( struct inotify_event * ) &buffer[ i ];
+
+            if ( event->mask & IN_Q_OVERFLOW )
+                overflow = true;
+            else if ( event->len > 0 )
+            {
+                for ( guint dirNo = 0; dirNo < NUM_ICON_DIRS; dirNo++ )
+                {
+                    if ( event->wd != _wds[dirNo] )
+                        continue;
+
+                    bool present = ( event->mask & ( IN_CREATE | IN_MOVED_TO ) ) != 0;
+                    _setPresent ( event->name, dirNo, present );
+                }
+            }
+
+            i += EVENT_SIZE + event->len;
+        }
+    }
+
+    if ( length < 0 && errno != EAGAIN )
+        perror( "read(inotify)" );
+
+    // Some events are lost, listing everything again
+    if ( overflow )
+    {
+        g_hash_table_remove_all ( _icons );
+        for ( guint i = 0; i < NUM_ICON_DIRS; i++ )
+            _scan ( i );
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ *  Copyright (c) 2010 Andry Gunawan <angun33@gmail.com>
+ *
+ *  Parts of this file are based on Telescope which is
+ *  Copyright (c) 2010 Ilya Skriblovsky <Ilya.Skriblovsky@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef ICONINDEX_H
+#define ICONINDEX_H
+
+#include <glib.h>
+
+// Index of icon files in the standard icon directories.
+//
+// Directories are listed once at startup and kept up to date with
+// inotify, so resolving an icon does not touch the file system.
+class IconIndex
+{
+public:
+    IconIndex();
+    ~IconIndex();
+
+    static IconIndex * instance() { return _instance; }
+
+    // Returns directory containing the icon file, or NULL. customPath is
+    // application's own X-Icon-path, it is preferred over all standard
+    // directories except the first one. Returned string is either static
+    // or customPath.
+    const gchar * lookup(const gchar *icon, const gchar *customPath);
+
+    // Standard directories in the order of preference
+    static const guint DIR_COUNT = 5;
+    static const gchar * dir(guint dirNo);
+
+private:
+    static IconIndex * _instance;
+
+    // icon file name -> bit mask of directories containing it
+    GHashTable *_icons;
+
+    int _fd;
+    int *_wds;
+
+    void _scan(guint dirNo);
+    void _setPresent(const gchar *icon, guint dirNo, bool present);
+    void onInotify(int fd);
+};
+
+#endif // ICONINDEX_H
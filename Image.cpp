@@ -14,7 +14,10 @@
 #include <string.h>
 #include <stdlib.h>
 
-#include <Imlib2.h>
+#include <X11/Xutil.h>
+
+#include "ImageLoader.h"
+#include "XTools.h"
 
 
 
@@ -64,39 +67,46 @@ Image::Image(Display *dpy, const char *filename)
 
     requestRGBAVisual(_dpy);
 
-    Imlib_Image image = imlib_load_image(filename);
-    if (image == 0)
+    // Usually the file is already decoded by worker thread
+    DecodedImage *decoded = ImageLoader::instance() ?
+        ImageLoader::instance()->take(filename) :
+        ImageLoader::decode(filename);
+
+    if (decoded == 0)
     {
         fprintf(stderr, "Cannot load image: %s\n", filename);
         return;
     }
 
-    imlib_context_set_image(image);
-    _width = imlib_image_get_width();
-    _height = imlib_image_get_height();
+    upload(decoded);
+    delete decoded;
+}
+
+
+Image::Image(Display *dpy, const char *filename, const DecodedImage *decoded)
+    :_dpy(dpy), _pixmap(0), _picture(0),
+     _width(0), _height(0), _repeatType(RepeatNone)
+{
+    _filename = strdup(filename);
+
+    requestRGBAVisual(_dpy);
 
+    if (decoded == 0)
+    {
+        fprintf(stderr, "Cannot load image: %s\n", filename);
+        return;
+    }
 
-    // Making image with premultiplied alpha
-    Imlib_Image premul = imlib_create_image(_width, _height);
-    imlib_context_set_image(premul);
-    imlib_context_set_color(0, 0, 0, 255);
-    imlib_image_fill_rectangle(0, 0, _width, _height);
-    imlib_context_set_blend(1);
-    imlib_blend_image_onto_image(image, 0, 0, 0, _width, _height, 0, 0, _width, _height);
-    imlib_image_copy_alpha_to_image(image, 0, 0);
+    upload(decoded);
+}
 
-    _pixmap = XCreatePixmap(_dpy, RootWindow(_dpy, DefaultScreen(_dpy)), _width, _height, 32);
-    imlib_context_set_display(_dpy);
-    imlib_context_set_colormap(colormap);
-    imlib_context_set_visual(rgbaVisual.visual);
-    imlib_context_set_drawable(_pixmap);
-    imlib_context_set_blend(0);
-    imlib_render_image_on_drawable(0, 0);
 
-    imlib_free_image();
-    imlib_context_set_image(image);
-    imlib_free_image();
+void Image::upload(const DecodedImage *decoded)
+{
+    _width = decoded->width;
+    _height = decoded->height;
 
+    _pixmap = XTools::createARGBPixmap(decoded->pixels, _width, _height);
     _picture = XRenderCreatePicture(_dpy, _pixmap, rgbaFormat, 0, 0);
 }
 
@@ -129,6 +139,8 @@ Image::~Image()
 
 void Image::setRepeatType(int repeatType)
 {
+    _repeatType = repeatType;
+
     if (! _picture) return;
 
     XRenderPictureAttributes pictureAttrs;
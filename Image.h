@@ -15,6 +15,7 @@
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrender.h>
 
+struct DecodedImage;
 
 class Image
 {
@@ -29,10 +30,12 @@ class Image
 
         char *_filename;
 
+        void upload(const DecodedImage *decoded);
 
     public:
         Image();
         Image(Display *dpy, const char *filename);
+        Image(Display *dpy, const char *filename, const DecodedImage *decoded);
         Image(Display *dpy, int width, int height, int depth = 32);
         ~Image();
 
@@ -0,0 +1,472 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+#include "ImageLoader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+
+#include <png.h>
+#include <Imlib2.h>
+
+#include "Image.h"
+#include "XEventLoop.h"
+#include "Premultiply.h"
+
+
+// No point in more threads on handhelds and small benefit on desktops
+#define MAX_THREADS 4
+
+
+struct ImageLoader::Request
+{
+    enum State { Queued, Decoding, Done };
+
+    char *filename;
+    bool premultiply;
+    State state;
+
+    // Empty for prefetch() requests
+    ImageCallback callback;
+
+    // Cancelled while decoding, worker deletes it when done
+    bool orphan;
+
+    // NULL if worker could not decode the file. X thread tries imlib then
+    DecodedImage *result;
+
+    Request(const char *filename, bool premultiply)
+        : filename(strdup(filename)), premultiply(premultiply), state(Queued),
+          orphan(false), result(0)
+    { }
+
+    ~Request()
+    {
+        free(filename);
+        delete result;
+    }
+};
+
+
+ImageLoader* ImageLoader::_instance = 0;
+
+
+// Thread safe, returns NULL if file is not a PNG or is broken
+static DecodedImage* decodePng(const char *filename, bool premultiply)
+{
+    FILE *f = fopen(filename, "rb");
+    if (f == 0)
+        return 0;
+
+    png_byte signature[8];
+    if (fread(signature, 1, sizeof(signature), f) != sizeof(signature) ||
+        png_sig_cmp(signature, 0, sizeof(signature)) != 0)
+    {
+        fclose(f);
+        return 0;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0);
+    png_infop info = png ? png_create_info_struct(png) : 0;
+    if (info == 0)
+    {
+        png_destroy_read_struct(&png, 0, 0);
+        fclose(f);
+        return 0;
+    }
+
+    // Modified after setjmp
+    DecodedImage * volatile image = 0;
+    png_bytep * volatile rows = 0;
+
+    if (setjmp(png_jmpbuf(png)))
+    {
+        delete image;
+        delete[] rows;
+        png_destroy_read_struct(&png, &info, 0);
+        fclose(f);
+        return 0;
+    }
+
+    png_init_io(png, f);
+    png_set_sig_bytes(png, sizeof(signature));
+    png_read_info(png, info);
+
+    int width = png_get_image_width(png, info);
+    int height = png_get_image_height(png, info);
+    int colorType = png_get_color_type(png, info);
+
+    // Converting everything to 8-bit RGBA
+    png_set_expand(png);
+    png_set_strip_16(png);
+    if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png);
+    if (! (colorType & PNG_COLOR_MASK_ALPHA) && ! png_get_valid(png, info, PNG_INFO_tRNS))
+        png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+
+    // ...and then to native-endian ARGB32
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    png_set_bgr(png);
+#else
+    png_set_swap_alpha(png);
+#endif
+
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    image = new DecodedImage(width, height);
+    rows = new png_bytep[height];
+    for (int y = 0; y < height; ++y)
+        rows[y] = (png_bytep)(image->pixels + y * width);
+
+    png_read_image(png, rows);
+    png_read_end(png, 0);
+
+    delete[] rows;
+    png_destroy_read_struct(&png, &info, 0);
+    fclose(f);
+
+    if (premultiply)
+        Premultiply::premultiply(image->pixels, image->width * image->height);
+
+    return image;
+}
+
+
+// Must be called from X thread only
+static DecodedImage* decodeImlib(const char *filename, bool premultiply)
+{
+    Imlib_Image imlibImage = imlib_load_image(filename);
+    if (imlibImage == 0)
+        return 0;
+
+    imlib_context_set_image(imlibImage);
+
+    DecodedImage *image = new DecodedImage(imlib_image_get_width(), imlib_image_get_height());
+    memcpy(image->pixels, imlib_image_get_data_for_reading_only(),
+        image->width * image->height * sizeof(unsigned int));
+
+    // Imlib leaves garbage in alpha channel of opaque images
+    if (! imlib_image_has_alpha())
+        for (int i = 0; i < image->width * image->height; ++i)
+            image->pixels[i] |= 0xff000000;
+
+    imlib_free_image();
+
+    if (premultiply)
+        Premultiply::premultiply(image->pixels, image->width * image->height);
+
+    return image;
+}
+
+
+DecodedImage* ImageLoader::decode(const char *filename, bool premultiply)
+{
+    DecodedImage *image = decodePng(filename, premultiply);
+    if (image == 0)
+        image = decodeImlib(filename, premultiply);
+    return image;
+}
+
+
+
+ImageLoader::ImageLoader(Display *dpy): _dpy(dpy)
+{
+    if (_instance != 0)
+        printf("ImageLoader singleton created twice!\n");
+
+    _instance = this;
+
+    _quit = false;
+
+    pthread_mutex_init(&_mutex, 0);
+    pthread_cond_init(&_queueCond, 0);
+    pthread_cond_init(&_doneCond, 0);
+
+    _eventFd = eventfd(0, 0);
+    if (_eventFd < 0)
+        perror("eventfd");
+    else
+    {
+        fcntl(_eventFd, F_SETFL, O_NONBLOCK);
+        fcntl(_eventFd, F_SETFD, FD_CLOEXEC);
+        XEventLoop::instance()->addFdWatch(_eventFd, Delegate(this, &ImageLoader::onEventFd));
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    _threadsCount = cores < 1 ? 1 : cores > MAX_THREADS ? MAX_THREADS : (int)cores;
+
+    _threads = new pthread_t[_threadsCount];
+    for (int i = 0; i < _threadsCount; ++i)
+    {
+        if (pthread_create(&_threads[i], 0, workerThread, this) != 0)
+        {
+            // Requests will be decoded in take() then
+            perror("pthread_create");
+            _threadsCount = i;
+            break;
+        }
+    }
+}
+
+
+ImageLoader::~ImageLoader()
+{
+    pthread_mutex_lock(&_mutex);
+    _quit = true;
+    pthread_cond_broadcast(&_queueCond);
+    pthread_mutex_unlock(&_mutex);
+
+    for (int i = 0; i < _threadsCount; ++i)
+        pthread_join(_threads[i], 0);
+    delete[] _threads;
+
+    for (Vector<Request*>::Iter i = _requests.head(); i; ++i)
+        delete *i;
+
+    if (_eventFd >= 0)
+    {
+        XEventLoop::instance()->removeFdWatch(_eventFd);
+        close(_eventFd);
+    }
+
+    pthread_cond_destroy(&_doneCond);
+    pthread_cond_destroy(&_queueCond);
+    pthread_mutex_destroy(&_mutex);
+
+    _instance = 0;
+}
+
+
+void* ImageLoader::workerThread(void *arg)
+{
+    ((ImageLoader*)arg)->worker();
+    return 0;
+}
+
+
+void ImageLoader::worker()
+{
+    pthread_mutex_lock(&_mutex);
+
+    while (! _quit)
+    {
+        Request *request = 0;
+        for (Vector<Request*>::Iter i = _requests.head(); i; ++i)
+            if ((*i)->state == Request::Queued)
+            {
+                request = *i;
+                break;
+            }
+
+        if (request == 0)
+        {
+            pthread_cond_wait(&_queueCond, &_mutex);
+            continue;
+        }
+
+        request->state = Request::Decoding;
+        pthread_mutex_unlock(&_mutex);
+
+        DecodedImage *result = decodePng(request->filename, request->premultiply);
+
+        pthread_mutex_lock(&_mutex);
+        request->result = result;
+        request->state = Request::Done;
+
+        if (request->orphan)
+        {
+            _requests.removeByValue(request);
+            delete request;
+        }
+        else if (! request->callback.empty() && _eventFd >= 0)
+        {
+            unsigned long long one = 1;
+            if (write(_eventFd, &one, sizeof(one)) < 0)
+                perror("write(eventfd)");
+        }
+
+        pthread_cond_broadcast(&_doneCond);
+    }
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+
+ImageLoader::Request* ImageLoader::findPrefetched(const char *filename, bool premultiply)
+{
+    for (Vector<Request*>::Iter i = _requests.head(); i; ++i)
+    {
+        Request *request = *i;
+        if (request->callback.empty() && ! request->orphan &&
+            request->premultiply == premultiply && strcmp(request->filename, filename) == 0)
+            return request;
+    }
+    return 0;
+}
+
+
+void ImageLoader::drop(Request *request)
+{
+    if (request->state == Request::Decoding)
+        request->orphan = true;
+    else
+    {
+        _requests.removeByValue(request);
+        delete request;
+    }
+}
+
+
+void ImageLoader::prefetch(const char *filename, bool premultiply)
+{
+    pthread_mutex_lock(&_mutex);
+
+    if (findPrefetched(filename, premultiply) == 0)
+    {
+        _requests.append(new Request(filename, premultiply));
+        pthread_cond_signal(&_queueCond);
+    }
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+
+void ImageLoader::cancelPrefetch(const char *filename, bool premultiply)
+{
+    pthread_mutex_lock(&_mutex);
+
+    Request *request = findPrefetched(filename, premultiply);
+    if (request != 0)
+        drop(request);
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+
+DecodedImage* ImageLoader::take(const char *filename, bool premultiply)
+{
+    pthread_mutex_lock(&_mutex);
+
+    Request *request = findPrefetched(filename, premultiply);
+
+    if (request == 0 || request->state == Request::Queued)
+    {
+        // Not started yet, no reason to wait for a free worker
+        if (request != 0)
+        {
+            _requests.removeByValue(request);
+            delete request;
+        }
+        pthread_mutex_unlock(&_mutex);
+
+        return decode(filename, premultiply);
+    }
+
+    while (request->state != Request::Done)
+        pthread_cond_wait(&_doneCond, &_mutex);
+
+    _requests.removeByValue(request);
+    pthread_mutex_unlock(&_mutex);
+
+    DecodedImage *result = request->result;
+    request->result = 0;
+    delete request;
+
+    if (result == 0)
+        result = decodeImlib(filename, premultiply);
+
+    return result;
+}
+
+
+ImageLoader::Request* ImageLoader::load(const char *filename, ImageCallback callback)
+{
+    pthread_mutex_lock(&_mutex);
+
+    // Taking over prefetched file, it may be decoded already
+    Request *request = findPrefetched(filename, true);
+    if (request != 0)
+    {
+        request->callback = callback;
+
+        if (request->state == Request::Done && _eventFd >= 0)
+        {
+            unsigned long long one = 1;
+            if (write(_eventFd, &one, sizeof(one)) < 0)
+                perror("write(eventfd)");
+        }
+    }
+    else
+    {
+        request = new Request(filename, true);
+        request->callback = callback;
+
+        _requests.append(request);
+        pthread_cond_signal(&_queueCond);
+    }
+
+    pthread_mutex_unlock(&_mutex);
+
+    return request;
+}
+
+
+void ImageLoader::cancel(Request *request)
+{
+    pthread_mutex_lock(&_mutex);
+    drop(request);
+    pthread_mutex_unlock(&_mutex);
+}
+
+
+void ImageLoader::onEventFd(int fd)
+{
+    unsigned long long count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("read(eventfd)");
+
+    // Picking requests one by one: callbacks may call load() or cancel()
+    while (true)
+    {
+        Request *request = 0;
+
+        pthread_mutex_lock(&_mutex);
+        for (Vector<Request*>::Iter i = _requests.head(); i; ++i)
+            if ((*i)->state == Request::Done && ! (*i)->callback.empty())
+            {
+                request = *i;
+                _requests.remove(i);
+                break;
+            }
+        pthread_mutex_unlock(&_mutex);
+
+        if (request == 0)
+            break;
+
+        DecodedImage *decoded = request->result;
+        request->result = 0;
+        if (decoded == 0)
+            decoded = decodeImlib(request->filename, request->premultiply);
+
+        Image *image = new Image(_dpy, request->filename, decoded);
+        delete decoded;
+
+        ImageCallback callback = request->callback;
+        delete request;
+
+        callback(image);
+    }
+}
@@ -0,0 +1,120 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+// ImageLoader - decodes image files in worker threads
+//
+// PNG files are decoded with libpng by a pool of worker threads, one per
+// CPU core, into ARGB32 buffers (premultiplied unless asked otherwise).
+// Imlib2 is not thread safe, so other formats are decoded with it in the
+// X thread when the result is picked up.
+//
+// There are two ways to get an image:
+//
+//  - prefetch() several files and then construct Image objects as usual.
+//    Image constructor picks decoded buffer with take(), waiting for the
+//    worker only if it is still busy with this file.
+//
+//  - load() with a callback. Worker signals eventfd watched by XEventLoop
+//    and the callback gets uploaded Image in the X thread.
+
+#ifndef __TELESCOPE_IMAGE_LOADER_H
+#define __TELESCOPE_IMAGE_LOADER_H
+
+#include <pthread.h>
+
+#include <X11/Xlib.h>
+
+#include "Delegate.h"
+#include "Vector.h"
+
+class Image;
+
+
+// Decoded pixels in native-endian ARGB32
+struct DecodedImage
+{
+    int width;
+    int height;
+    unsigned int *pixels;
+
+    DecodedImage(int w, int h): width(w), height(h), pixels(new unsigned int[w * h]) { }
+    ~DecodedImage() { delete[] pixels; }
+};
+
+
+// Receives new Image, which is owned by callee
+typedef Delegate1<Image*> ImageCallback;
+
+
+class ImageLoader
+{
+    public:
+        // Handle of load() request, used only for cancel()
+        struct Request;
+
+    private:
+        static ImageLoader *_instance;
+
+        Display *_dpy;
+
+        pthread_t *_threads;
+        int _threadsCount;
+
+        pthread_mutex_t _mutex;
+        pthread_cond_t _queueCond;  // new request queued or quitting
+        pthread_cond_t _doneCond;   // some request is decoded
+        bool _quit;
+
+        // All requests which are not picked up yet, guarded by _mutex
+        Vector<Request*> _requests;
+
+        // Signalled by workers when load() request is done
+        int _eventFd;
+
+        Request* findPrefetched(const char *filename, bool premultiply);
+
+        // Deletes request or leaves it to the worker, _mutex must be locked
+        void drop(Request *request);
+
+        static void* workerThread(void *arg);
+        void worker();
+
+        void onEventFd(int fd);
+
+    public:
+        ImageLoader(Display *dpy);
+        ~ImageLoader();
+
+        static ImageLoader* instance() { return _instance; }
+
+        // Starts decoding of the file in background
+        void prefetch(const char *filename, bool premultiply = true);
+
+        // Forgets prefetch() request nobody picked up, so that its decoded
+        // buffer does not stay in memory
+        void cancelPrefetch(const char *filename, bool premultiply = true);
+
+        // Returns decoded file or NULL if it cannot be loaded. Caller
+        // owns the result. Waits for prefetched file or decodes it in
+        // the calling thread if no worker has started it yet.
+        DecodedImage* take(const char *filename, bool premultiply = true);
+
+        // Decodes file and calls callback from the event loop. Picks up
+        // prefetch() request for the same file if there is one.
+        Request* load(const char *filename, ImageCallback callback);
+
+        // Callback of load() request will not be called
+        void cancel(Request *request);
+
+        // Decodes file in the calling thread, which must be the X thread
+        static DecodedImage* decode(const char *filename, bool premultiply = true);
+};
+
+
+#endif
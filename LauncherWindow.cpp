@@ -31,6 +31,7 @@
 #include "Resources.h"
 #include "Settings.h"
 #include "MenuReader.h"
+#include "ImageLoader.h"
 #include "XTools.h"
 #include "constant.h"
 
@@ -41,11 +42,20 @@
 
 
 
+// Seconds
+#define SWIPE_DURATION 0.25
+// Pixels finger must travel over the page to change section
+#define SWIPE_THRESHOLD 40
+
+
 LauncherWindow* LauncherWindow::_instance = 0;
 
 
 LauncherWindow::LauncherWindow ( Display *dpy/*, SectionList *list */)
-        :_dpy ( dpy )//, _sections ( list )
+        :_dpy ( dpy ), //_sections ( list ),
+         _pageNode ( Delegate ( this, &LauncherWindow::drawPage ) ),
+         _panelNode ( Delegate ( this, &LauncherWindow::drawPanel ) ),
+         _categoryIconsBarNode ( Delegate ( this, &LauncherWindow::drawCategoryIconsBar ) )
 {
     LauncherWindow::_instance = this;
 
@@ -97,8 +107,14 @@ LauncherWindow::LauncherWindow ( Display *dpy/*, SectionList *list */)
     XSelectInput ( _dpy, _rootWindow, StructureNotifyMask | SubstructureNotifyMask | PropertyChangeMask );
 
     // Double buffering pixmap
+    _scene = new Scene ( _dpy, _win, _gc );
     _buffer = 0;
     recreateBuffer();
+
+    _scene->add ( &_wallpaperNode );
+    _scene->add ( &_pageNode );
+    _scene->add ( &_panelNode );
+    _scene->add ( &_categoryIconsBarNode );
     redrawSections();
 
 
@@ -106,13 +122,18 @@ LauncherWindow::LauncherWindow ( Display *dpy/*, SectionList *list */)
 
     _currentSection = 0;
 
-    _repaintOnIdle = false;
+    Application::setImageChangedCallback(onTileChanged, this);
 
     XEventLoop::instance()->addHandler(this);
     XEventLoop::instance()->addIdleTask(this);
 
 
     // Initializing sections panel
+    ImageLoader::instance()->prefetch(Settings::instance()->panelBackgroundFilename());
+    ImageLoader::instance()->prefetch(Settings::instance()->panelFocusLeftFilename());
+    ImageLoader::instance()->prefetch(Settings::instance()->panelFocusRightFilename());
+    ImageLoader::instance()->prefetch(Settings::instance()->panelFocusMiddleFilename());
+
     _panelBackground = new Image(_dpy, Settings::instance()->panelBackgroundFilename());
     _panelBackground->setRepeatType(RepeatNormal);
     _panelFocusLeft = new Image(_dpy, Settings::instance()->panelFocusLeftFilename());
@@ -135,19 +156,43 @@ LauncherWindow::LauncherWindow ( Display *dpy/*, SectionList *list */)
     );
 
 
+    _panelDirty = true;
+    _panelSection = 0;
+
     _longtapTimeout = 0;
 
+    _swipeTimeout = 0;
+    _swipeDirection = 0;
+    _pressX = _pressY = 0;
+
+    _searching = false;
+    _searchQuery = g_string_new ( "" );
+    _searchResults = g_ptr_array_new();
+    _searchSection = new Section ( _dpy, "Search" );
+
+    _menuReloadPending = false;
+    MenuReader::getInstance()->setOnChange( Delegate( this, &LauncherWindow::onMenuChange ) );
+
 
     // Load category icons
-    _categoryIconsBarVisible = false;
+    _categoryIconsBarNode.setVisible(false);
     _categoryIconsBar = 0;
     buildCategoryIconsBar();
 
+    layoutNodes();
+
     _ignoreNextButtonRelease = false;
 }
 
 LauncherWindow::~LauncherWindow()
 {
+    Application::setImageChangedCallback(0, 0);
+    stopSwipe();
+
+    delete _searchSection;
+    g_ptr_array_free ( _searchResults, TRUE );
+    g_string_free ( _searchQuery, TRUE );
+
     XftFontClose(_dpy, _xftFont);
     XftDrawDestroy(_xftDraw);
 
@@ -161,6 +206,7 @@ LauncherWindow::~LauncherWindow()
 
 //    delete _sections;
 
+    delete _scene;
     delete _buffer;
 
     XFreeGC ( _dpy, _gc );
@@ -183,6 +229,8 @@ void LauncherWindow::show()
 {
     _shown = true;
 
+    _scene->invalidateAll();
+
     XMapWindow ( _dpy, _win );
 
     XTools::switchToWindow ( _win );
@@ -192,8 +240,13 @@ void LauncherWindow::hide()
 {
     XUnmapWindow ( _dpy, _win );
 
+    stopSwipe();
+    stopSearch();
     _shown = false;
-    _categoryIconsBarVisible = false;
+    _categoryIconsBarNode.setVisible(false);
+
+    if ( _menuReloadPending )
+        onMenuChange();
 }
 
 bool LauncherWindow::shown()
@@ -204,13 +257,13 @@ bool LauncherWindow::shown()
 void LauncherWindow::quit()
 {
     hide();
-    _repaintOnIdle = false;
     _breakEventLoop = true;
 }
 
 void LauncherWindow::_goPrevious()
 {
 //    _prevButtonPressed = false;
+    uint from = _currentSection;
 
     // go to previous section
     if ( _currentSection == 0 )
@@ -219,12 +272,14 @@ void LauncherWindow::_goPrevious()
         _currentSection--;
 
     if ( _shown )
-        _repaintOnIdle = true;
+        startSwipe ( from, -1 );
 }
 
 void LauncherWindow::_goNext()
 {
 //    _nextButtonPressed = false;
+    uint from = _currentSection;
+
     // go to next section
     if ( _currentSection == MenuReader::getInstance()->sectionList()->getSize() - 1 )
         _currentSection = 0;
@@ -232,7 +287,51 @@ void LauncherWindow::_goNext()
         _currentSection++;
 
     if ( _shown )
-        _repaintOnIdle = true;
+        startSwipe ( from, 1 );
+}
+
+void LauncherWindow::startSwipe(uint from, int direction)
+{
+    if ( from == _currentSection )
+        return;
+
+    _swipeFrom = from;
+    _swipeDirection = direction;
+    _swipeStart = XEventLoop::currentTime();
+
+    if ( _swipeTimeout == 0 )
+        _swipeTimeout = XEventLoop::instance()->addTimeout(0, Delegate(this, &LauncherWindow::onSwipeFrame));
+}
+
+void LauncherWindow::stopSwipe()
+{
+    if ( _swipeTimeout )
+    {
+        XEventLoop::instance()->cancelTimeout(_swipeTimeout);
+        _swipeTimeout = 0;
+    }
+
+    _swipeDirection = 0;
+}
+
+void LauncherWindow::onSwipeFrame(Timeout* timeout)
+{
+    _swipeTimeout = 0;
+
+    // Position depends on time, not on frame count, so slow frames are
+    // skipped and swipe takes the same time anyway
+    bool finished = XEventLoop::currentTime() - _swipeStart >= SWIPE_DURATION;
+
+    _pageNode.invalidate();
+    paint();
+
+    if ( finished )
+        _swipeDirection = 0;
+    else
+        _swipeTimeout = XEventLoop::instance()->addTimeout(
+            1.0 / Settings::instance()->repaintRate(),
+            Delegate(this, &LauncherWindow::onSwipeFrame)
+        );
 }
 
 void LauncherWindow::redrawSections()
@@ -281,7 +380,10 @@ void LauncherWindow::setNewSize(int width, int height)
     _height = height;
     XMoveResizeWindow(_dpy, _win, 0, 0, _width, _height);
 
+    stopSwipe();
+
     recreateBuffer();
+    layoutNodes();
 }
 
 void LauncherWindow::_onKeyPress(XKeyEvent *event)
@@ -302,7 +404,43 @@ void LauncherWindow::_onKeyPress(XKeyEvent *event)
 
     bool portrait = _width < _height;
 
-    if (event->keycode == XKeysymToKeycode(_dpy, portrait ? XK_Up : XK_Left))
+    char text[8];
+    KeySym keysym;
+    int length = XLookupString(event, text, sizeof(text), &keysym, 0);
+
+    // Printable characters start search or refine it
+    if (length == 1 && (unsigned char)text[0] >= 0x20 && (unsigned char)text[0] < 0x7f &&
+        (_searching || text[0] != ' '))
+    {
+        g_string_append_c(_searchQuery, text[0]);
+        updateSearch();
+    }
+    else if (_searching && keysym == XK_BackSpace)
+    {
+        g_string_truncate(_searchQuery, _searchQuery->len - 1);
+        if (_searchQuery->len > 0)
+            updateSearch();
+        else
+            stopSearch();
+    }
+    else if (_searching && keysym == XK_Escape)
+        stopSearch();
+    else if (_searching && keysym == XK_Return)
+    {
+        if (_searchResults->len > 0)
+        {
+            Application *app = (Application*)g_ptr_array_index(_searchResults, 0);
+            if (app->execute())
+                showNotification( g_strconcat ("Starting ", app->getApplicationName(), NULL) );
+            else
+                showNotification( "Execution failed" );
+
+            hide();
+        }
+    }
+    else if (_searching)
+        ;
+    else if (event->keycode == XKeysymToKeycode(_dpy, portrait ? XK_Up : XK_Left))
         _goPrevious();
     else if (event->keycode == XKeysymToKeycode(_dpy, portrait ? XK_Down : XK_Right))
         _goNext();
@@ -310,6 +448,48 @@ void LauncherWindow::_onKeyPress(XKeyEvent *event)
         hide();
 }
 
+void LauncherWindow::updateSearch()
+{
+    if (! _searching)
+    {
+        stopSwipe();
+        _searching = true;
+    }
+
+    MenuReader::getInstance()->searchIndex()->search(_searchQuery->str, _searchResults);
+
+    // Only one page of results, unchanged cells keep their tiles
+    _searchSection->clearApplications();
+    for (guint i = 0; i < _searchResults->len && i < NUM_ROWS * NUM_COLS; i++)
+        _searchSection->addApplication((Application*)g_ptr_array_index(_searchResults, i));
+
+    _panelDirty = true;
+    _pageNode.invalidate();
+}
+
+void LauncherWindow::stopSearch()
+{
+    if (! _searching)
+        return;
+
+    _searching = false;
+    g_string_truncate(_searchQuery, 0);
+    g_ptr_array_set_size(_searchResults, 0);
+    _searchSection->clearApplications();
+    _searchSection->releasePage();
+
+    _panelDirty = true;
+    _pageNode.invalidate();
+}
+
+Section* LauncherWindow::shownSection()
+{
+    if (_searching)
+        return _searchSection;
+    else
+        return MenuReader::getInstance()->sectionList()->get(_currentSection);
+}
+
 void LauncherWindow::_onKeyRelease(XKeyEvent *event)
 {
 }
@@ -325,12 +505,17 @@ void LauncherWindow::onLongTap(Timeout* timeout)
 
     _ignoreNextButtonRelease = true;
 
-    _categoryIconsBarVisible = true;
-    _repaintOnIdle = true;
+    _categoryIconsBarNode.setVisible(true);
 }
 
 void LauncherWindow::_onButtonEvent(XEvent *event)
 {
+    if (event->type == ButtonPress)
+    {
+        _pressX = event->xbutton.x;
+        _pressY = event->xbutton.y;
+    }
+
     if (event->type == ButtonRelease)
     {
         if (_longtapTimeout)
@@ -348,7 +533,7 @@ void LauncherWindow::_onButtonEvent(XEvent *event)
     }
 
 
-    if (event->type == ButtonPress && _categoryIconsBarVisible)
+    if (event->type == ButtonPress && _categoryIconsBarNode.visible())
     {
         if (
                 (
@@ -378,12 +563,13 @@ void LauncherWindow::_onButtonEvent(XEvent *event)
                     MenuReader::getInstance()->sectionList()->get(_currentSection)->setIcon(0, false);
                 else
                     MenuReader::getInstance()->sectionList()->get(_currentSection)->setIcon(_categoryIcons[iconNo-1], false);
+
+                _panelDirty = true;
             }
         }
 
         _ignoreNextButtonRelease = true;
-        _categoryIconsBarVisible = false;
-        _repaintOnIdle = true;
+        _categoryIconsBarNode.setVisible(false);
     }
     else if (
                 ((_width >=_height) && (event->xbutton.y > _height - _panelHeight)) ||
@@ -396,8 +582,10 @@ void LauncherWindow::_onButtonEvent(XEvent *event)
             int sectionNo = _width >= _height ?
                 event->xbutton.x / sectionWidth :
                 event->xbutton.y / sectionWidth;
+            stopSwipe();
+            stopSearch();
             _currentSection = sectionNo;
-            _repaintOnIdle = true;
+            _pageNode.invalidate();
 
             if (_longtapTimeout)
             {
@@ -409,8 +597,26 @@ void LauncherWindow::_onButtonEvent(XEvent *event)
     }
     else if (event->type == ButtonRelease)
     {
+        // Swipe along the panel direction changes section
+        int swipe = _width >= _height ?
+            event->xbutton.x - _pressX :
+            event->xbutton.y - _pressY;
+
+        if (_searching)
+            ;
+        else if (swipe < -SWIPE_THRESHOLD)
+        {
+            _goNext();
+            return;
+        }
+        else if (swipe > SWIPE_THRESHOLD)
+        {
+            _goPrevious();
+            return;
+        }
+
         // loop thru apps
-        Section *currentSection = MenuReader::getInstance()->sectionList()->get ( _currentSection );
+        Section *currentSection = shownSection();
         bool aHit = FALSE;
         bool success;
         Application *app;
@@ -453,8 +659,9 @@ void LauncherWindow::_onWinEvent(XEvent *event)
     {
         _onButtonEvent(event);
     }
-    else if ( event->type == Expose && event->xexpose.count < 1 )
-        _repaintOnIdle = true;
+    else if ( event->type == Expose )
+        _scene->invalidate ( event->xexpose.x, event->xexpose.y,
+                             event->xexpose.width, event->xexpose.height );
 }
 
 void LauncherWindow::showNotification(const char *message)
@@ -475,221 +682,374 @@ void LauncherWindow::showNotification(const char *message)
     dbus_message_unref(call);
 }
 
-void LauncherWindow::paint()
+void LauncherWindow::redrawPanel()
 {
-    if ( ! _shown )
-        return;
+    _panelDirty = false;
+    _panelSection = _currentSection;
+
+    int sectionWidth = _panelWidth / MenuReader::getInstance()->sectionList()->getSize();
+
+    XRenderComposite(_dpy, PictOpSrc,
+        _panelBackground->picture(), None, _panel->picture(),
+        0, 0, 0, 0,
+        0, 0,
+        _panelWidth, _panelHeight
+    );
 
+    XRenderComposite(_dpy, PictOpOver,
+        _panelFocusLeft->picture(), None, _panel->picture(),
+        0, 0, 0, 0,
+        sectionWidth * _currentSection, 0,
+        _panelFocusLeft->width(), _panelHeight
+    );
+    XRenderComposite(_dpy, PictOpOver,
+        _panelFocusRight->picture(), None, _panel->picture(),
+        0, 0, 0, 0,
+        sectionWidth * (_currentSection+1) - _panelFocusRight->width(), 0,
+        _panelFocusRight->width(), _panelHeight
+    );
+    XRenderComposite(_dpy, PictOpOver,
+        _panelFocusMiddle->picture(), None, _panel->picture(),
+        0, 0, 0, 0,
+        sectionWidth * _currentSection + _panelFocusLeft->width(), 0,
+        sectionWidth - _panelFocusLeft->width() - _panelFocusRight->width(), _panelHeight
+    );
 
-    // draw background
-    XCopyArea ( _dpy, Resources::instance()->wallpaper()->pixmap(), _buffer->pixmap(), _gc,
-                0, 0, _width, _height, 0, 0
-              );
 
-//    Resources * resources = Resources::instance();
+    XftColor fontColor = { 0, { 0xffff, 0xffff, 0xffff, 0xffff } };
+    XftColor fontColorShadow = { 0, { 0x2000, 0x2000, 0x2000, 0xffff } };
 
-    // draw the current section
-    Section *currentSection = MenuReader::getInstance()->sectionList()->get ( _currentSection );
-    bool landscape = _width >= _height;
-    currentSection->draw(
-        _dpy, _buffer,
-        landscape ? 0 : _panelHeight,
-        0,
-        landscape ? _width : _width - _panelHeight,
-        landscape ? _height - _panelHeight : _height
+    for (unsigned int i = 0; i < MenuReader::getInstance()->sectionList()->getSize(); i++)
+    {
+        Section* section = MenuReader::getInstance()->sectionList()->get(i);
+        Image* icon = section->getIcon();
+
+        if (icon)
+        {
+            int x = (sectionWidth - icon->width()) / 2;
+            int y = (_panelHeight - icon->height()) / 2;
+
+            XRenderComposite(_dpy, PictOpOver,
+                icon->picture(), None, _panel->picture(),
+                0, 0, 0, 0,
+                i * sectionWidth + x, y,
+                icon->width(), icon->height()
+            );
+        }
+        else
+        {
+            const char *title = section->getNameWithPart();
+
+            const int pad = 5;
+
+            XRectangle rect = {
+                i * sectionWidth + pad, 0,
+                sectionWidth - 2 * pad, _panelHeight
+            };
+            Region clip = XCreateRegion();
+            XUnionRectWithRegion(&rect, clip, clip);
+
+
+            XGlyphInfo textInfo;
+            XftTextExtentsUtf8(
+                _dpy, _xftFont,
+                (const FcChar8*)title, strlen(title),
+                &textInfo
+            );
+
+            XftDrawSetClip(_xftDraw, clip);
+
+            int x = (sectionWidth - textInfo.width) / 2;
+            // textInfo.y instead of textInfo.height because height includes underline elements of letters
+            int y = (_panelHeight - textInfo.y) / 2 + textInfo.y;
+
+            if (x < pad) x = pad;
+
+            XftDrawStringUtf8(
+                _xftDraw, &fontColorShadow, _xftFont,
+                i * sectionWidth + x /*+ 1*/,
+                y + 1,
+                (const FcChar8*)title, strlen(title)
+            );
+            XftDrawStringUtf8(
+                _xftDraw, &fontColor, _xftFont,
+                i * sectionWidth + x,
+                y,
+                (const FcChar8*)title, strlen(title)
+            );
+
+            XDestroyRegion(clip);
+        }
+    }
+}
+
+void LauncherWindow::redrawSearchPanel()
+{
+    _panelDirty = false;
+    _panelSection = _currentSection;
+
+    XRenderComposite(_dpy, PictOpSrc,
+        _panelBackground->picture(), None, _panel->picture(),
+        0, 0, 0, 0,
+        0, 0,
+        _panelWidth, _panelHeight
+    );
+
+    XftColor fontColor = { 0, { 0xffff, 0xffff, 0xffff, 0xffff } };
+    XftColor fontColorShadow = { 0, { 0x2000, 0x2000, 0x2000, 0xffff } };
+
+    gchar *title = g_strdup_printf("Search: %s", _searchQuery->str);
+
+    XGlyphInfo textInfo;
+    XftTextExtentsUtf8(
+        _dpy, _xftFont,
+        (const FcChar8*)title, strlen(title),
+        &textInfo
     );
 
+    XftDrawSetClip(_xftDraw, 0);
+
+    const int pad = 5;
+    int x = pad * 2;
+    int y = (_panelHeight - textInfo.y) / 2 + textInfo.y;
 
+    XftDrawStringUtf8(
+        _xftDraw, &fontColorShadow, _xftFont,
+        x, y + 1,
+        (const FcChar8*)title, strlen(title)
+    );
+    XftDrawStringUtf8(
+        _xftDraw, &fontColor, _xftFont,
+        x, y,
+        (const FcChar8*)title, strlen(title)
+    );
+
+    g_free(title);
+}
+
+void LauncherWindow::layoutNodes()
+{
+    bool landscape = _width >= _height;
 
-    // Drawing bottom panel
+    _wallpaperNode.setGeometry ( 0, 0, _width, _height );
+
+    if ( landscape )
+    {
+        _pageNode.setGeometry ( 0, 0, _width, _height - _panelHeight );
+        _panelNode.setGeometry ( 0, _height - _panelHeight, _panelWidth, _panelHeight );
+        _categoryIconsBarNode.setGeometry ( 0, _height - _panelHeight - _categoryIconsBar->height(),
+                                            _categoryIconsBar->width(), _categoryIconsBar->height() );
+    }
+    else
+    {
+        // Panel and bar are rotated alongside left border
+        _pageNode.setGeometry ( _panelHeight, 0, _width - _panelHeight, _height );
+        _panelNode.setGeometry ( 0, 0, _panelHeight, _panelWidth );
+        _categoryIconsBarNode.setGeometry ( _panelHeight, 0,
+                                            _categoryIconsBar->height(), _categoryIconsBar->width() );
+    }
+}
+
+void LauncherWindow::drawPage(Picture dest)
+{
+    SectionList *sections = MenuReader::getInstance()->sectionList();
+    bool landscape = _width >= _height;
+    int pageX = _pageNode.x();
+    int pageWidth = _pageNode.width();
+    int pageHeight = _pageNode.height();
+
+    // draw the current section or search results
+    Section *currentSection = shownSection();
+
+    if ( _swipeDirection != 0 )
+    {
+        // Both pages slide along the panel, decelerating
+        double t = ( XEventLoop::currentTime() - _swipeStart ) / SWIPE_DURATION;
+        if ( t > 1 ) t = 1;
+        t = 1 - ( 1 - t ) * ( 1 - t );
+
+        int distance = landscape ? pageWidth : pageHeight;
+        int offset = (int)( distance * t ) * _swipeDirection;
+        int fromPos = -offset;
+        int toPos = _swipeDirection * distance - offset;
+
+        Image *fromPage = sections->get ( _swipeFrom )->page ( pageX, 0, pageWidth, pageHeight );
+        Image *toPage = currentSection->page ( pageX, 0, pageWidth, pageHeight );
+
+        XRenderComposite ( _dpy, PictOpOver,
+                           fromPage->picture(), None, dest,
+                           0, 0, 0, 0,
+                           pageX + ( landscape ? fromPos : 0 ), landscape ? 0 : fromPos,
+                           pageWidth, pageHeight );
+        XRenderComposite ( _dpy, PictOpOver,
+                           toPage->picture(), None, dest,
+                           0, 0, 0, 0,
+                           pageX + ( landscape ? toPos : 0 ), landscape ? 0 : toPos,
+                           pageWidth, pageHeight );
+    }
+    else
     {
-        int sectionWidth = _panelWidth / MenuReader::getInstance()->sectionList()->getSize();
+        Image *page = currentSection->page ( pageX, 0, pageWidth, pageHeight );
+
+        XRenderComposite ( _dpy, PictOpOver,
+                           page->picture(), None, dest,
+                           0, 0, 0, 0,
+                           pageX, 0,
+                           pageWidth, pageHeight );
+    }
+}
 
+// Portrait panel and bar are rotated 90° by these
+static XTransform identTransform = {{
+    { XDoubleToFixed(1), XDoubleToFixed(0), XDoubleToFixed(0) },
+    { XDoubleToFixed(0), XDoubleToFixed(1), XDoubleToFixed(0) },
+    { XDoubleToFixed(0), XDoubleToFixed(0), XDoubleToFixed(1) },
+}};
+
+static XTransform rotateTransform = {{
+    { XDoubleToFixed(0), XDoubleToFixed(1), XDoubleToFixed(0) },
+    { XDoubleToFixed(-1), XDoubleToFixed(0), XDoubleToFixed(0) },
+    { XDoubleToFixed(0), XDoubleToFixed(0), XDoubleToFixed(1) },
+}};
+
+void LauncherWindow::drawPanel(Picture dest)
+{
+    if (_width >= _height)
+    {
+        // Landscape
         XRenderComposite(_dpy, PictOpSrc,
-            _panelBackground->picture(), None, _panel->picture(),
+            _panel->picture(), None, dest,
             0, 0, 0, 0,
-            0, 0,
+            0, _height - _panelHeight,
             _panelWidth, _panelHeight
         );
+    }
+    else
+    {
+        // Portrait. Rotate panel 90° and blit alongside left border
+        XRenderSetPictureTransform(_dpy, _panel->picture(), &rotateTransform);
 
-        XRenderComposite(_dpy, PictOpOver,
-            _panelFocusLeft->picture(), None, _panel->picture(),
-            0, 0, 0, 0,
-            sectionWidth * _currentSection, 0,
-            _panelFocusLeft->width(), _panelHeight
+        XRenderComposite(_dpy, PictOpSrc,
+            _panel->picture(), 0, dest,
+            -_panelHeight, 0,
+            0, 0,
+            0, 0,
+            _panelHeight, _panelWidth
         );
-        XRenderComposite(_dpy, PictOpOver,
-            _panelFocusRight->picture(), None, _panel->picture(),
+
+        XRenderSetPictureTransform(_dpy, _panel->picture(), &identTransform);
+    }
+}
+
+void LauncherWindow::drawCategoryIconsBar(Picture dest)
+{
+    if (_width >= _height)
+    {
+        XRenderComposite(_dpy, PictOpSrc,
+            _categoryIconsBar->picture(), None, dest,
             0, 0, 0, 0,
-            sectionWidth * (_currentSection+1) - _panelFocusRight->width(), 0,
-            _panelFocusRight->width(), _panelHeight
+            0, _height - _panelHeight - _categoryIconsBar->height(),
+            _categoryIconsBar->width(), _categoryIconsBar->height()
         );
-        XRenderComposite(_dpy, PictOpOver,
-            _panelFocusMiddle->picture(), None, _panel->picture(),
-            0, 0, 0, 0,
-            sectionWidth * _currentSection + _panelFocusLeft->width(), 0,
-            sectionWidth - _panelFocusLeft->width() - _panelFocusRight->width(), _panelHeight
+    }
+    else
+    {
+        XRenderSetPictureTransform(_dpy, _categoryIconsBar->picture(), &rotateTransform);
+        XRenderComposite(_dpy, PictOpSrc,
+            _categoryIconsBar->picture(), 0, dest,
+            -_categoryIconsBar->height(), 0,
+            0, 0,
+            _panelHeight, 0,
+            _categoryIconsBar->height(), _categoryIconsBar->width()
         );
+        XRenderSetPictureTransform(_dpy, _categoryIconsBar->picture(), &identTransform);
+    }
+}
 
+void LauncherWindow::paint()
+{
+    if ( ! _shown )
+        return;
 
-        XftColor fontColor = { 0, { 0xffff, 0xffff, 0xffff, 0xffff } };
-        XftColor fontColorShadow = { 0, { 0x2000, 0x2000, 0x2000, 0xffff } };
+    // Panel is redrawn only when current section or section list changes
+    if ( _panelDirty || _panelSection != _currentSection )
+    {
+        if ( _searching )
+            redrawSearchPanel();
+        else
+            redrawPanel();
 
-        for (unsigned int i = 0; i < MenuReader::getInstance()->sectionList()->getSize(); i++)
-        {
-            Section* section = MenuReader::getInstance()->sectionList()->get(i);
-            Image* icon = section->getIcon();
+        _panelNode.invalidate();
+    }
 
-            if (icon)
-            {
-                int x = (sectionWidth - icon->width()) / 2;
-                int y = (_panelHeight - icon->height()) / 2;
-
-                XRenderComposite(_dpy, PictOpOver,
-                    icon->picture(), None, _panel->picture(),
-                    0, 0, 0, 0,
-                    i * sectionWidth + x, y,
-                    icon->width(), icon->height()
-                );
-            }
-            else
-            {
-                const char *title = section->getNameWithPart();
-
-                const int pad = 5;
-
-                XRectangle rect = {
-                    i * sectionWidth + pad, 0,
-                    sectionWidth - 2 * pad, _panelHeight
-                };
-                Region clip = XCreateRegion();
-                XUnionRectWithRegion(&rect, clip, clip);
-
-
-                XGlyphInfo textInfo;
-                XftTextExtentsUtf8(
-                    _dpy, _xftFont,
-                    (const FcChar8*)title, strlen(title),
-                    &textInfo
-                );
-
-                XftDrawSetClip(_xftDraw, clip);
-
-                int x = (sectionWidth - textInfo.width) / 2;
-                // textInfo.y instead of textInfo.height because height includes underline elements of letters
-                int y = (_panelHeight - textInfo.y) / 2 + textInfo.y;
-
-                if (x < pad) x = pad;
-
-                XftDrawStringUtf8(
-                    _xftDraw, &fontColorShadow, _xftFont,
-                    i * sectionWidth + x /*+ 1*/,
-                    y + 1,
-                    (const FcChar8*)title, strlen(title)
-                );
-                XftDrawStringUtf8(
-                    _xftDraw, &fontColor, _xftFont,
-                    i * sectionWidth + x,
-                    y,
-                    (const FcChar8*)title, strlen(title)
-                );
-
-                XDestroyRegion(clip);
-            }
-        }
+    _scene->render();
 
-        // Blit panel into buffer
-        if (_width > _height)
-        {
 
-            // Landscape
-            XCopyArea(
-                _dpy, _panel->pixmap(), _buffer->pixmap(), _gc,
-                0, 0, _panelWidth, _panelHeight,
-                0, _height - _panelHeight
-            );
+    // Tiles of neighbour sections are rendered when first shown, but their
+    // icons can be decoded in advance. Pages and prefetched icons are kept
+    // only for sections which are likely to be shown next.
+    SectionList *sections = MenuReader::getInstance()->sectionList();
+    if ( sections->getSize() == 0 )
+        return;
 
+    guint next = ( _currentSection + 1 ) % sections->getSize();
+    guint previous = ( _currentSection + sections->getSize() - 1 ) % sections->getSize();
 
-            if (_categoryIconsBarVisible)
-            {
-                XCopyArea(
-                    _dpy, _categoryIconsBar->pixmap(), _buffer->pixmap(), _gc,
-                    0, 0, _categoryIconsBar->width(), _categoryIconsBar->height(),
-                    0, _height - _panel->height() - _categoryIconsBar->height()
-                );
-            }
-        }
-        else
+    sections->get ( next )->prefetchIcons();
+    sections->get ( previous )->prefetchIcons();
+
+    for ( guint i = 0; i < sections->getSize(); i++ )
+        if ( i != _currentSection && i != next && i != previous )
         {
-            // Portrait. Rotate panel 90° and blit alongside left border
-
-            XTransform ident = {{
-                { XDoubleToFixed(1), XDoubleToFixed(0), XDoubleToFixed(0) },
-                { XDoubleToFixed(0), XDoubleToFixed(1), XDoubleToFixed(0) },
-                { XDoubleToFixed(0), XDoubleToFixed(0), XDoubleToFixed(1) },
-            }};
-
-            XTransform xform = {{
-                { XDoubleToFixed(0), XDoubleToFixed(1), XDoubleToFixed(0) },
-                { XDoubleToFixed(-1), XDoubleToFixed(0), XDoubleToFixed(0) },
-                { XDoubleToFixed(0), XDoubleToFixed(0), XDoubleToFixed(1) },
-            }};
-
-            XRenderSetPictureTransform(_dpy, _panel->picture(), &xform);
-
-            XRenderComposite(_dpy, PictOpSrc,
-                _panel->picture(), 0, _buffer->picture(),
-                -_panelHeight, 0,
-                0, 0,
-                0, 0,
-                _panelHeight, _panelWidth
-            );
+            sections->get ( i )->releasePage();
+            sections->get ( i )->cancelPrefetch();
+        }
 
-            XRenderSetPictureTransform(_dpy, _panel->picture(), &ident);
+    Application::trimImages();
+}
 
 
-            if (_categoryIconsBarVisible)
-            {
-                XRenderSetPictureTransform(_dpy, _categoryIconsBar->picture(), &xform);
-                XRenderComposite(_dpy, PictOpSrc,
-                    _categoryIconsBar->picture(), 0, _buffer->picture(),
-                    -_categoryIconsBar->height(), 0,
-                    0, 0,
-                    _panelHeight, 0,
-                    _categoryIconsBar->height(), _categoryIconsBar->width()
-                );
-                XRenderSetPictureTransform(_dpy, _categoryIconsBar->picture(), &ident);
-            }
-        }
-    }
+void LauncherWindow::onTileChanged(Application *app, void *data)
+{
+    LauncherWindow *self = (LauncherWindow*)data;
 
-    XCopyArea(_dpy, _buffer->pixmap(), _win, _gc,
-        0, 0,
-        _width, _height,
-        0, 0
-    );
-}
+    SectionList *sections = MenuReader::getInstance()->sectionList();
+    for ( guint i = 0; i < sections->getSize(); i++ )
+        sections->get(i)->invalidateApplication ( app );
+
+    // Search results are not in the section list
+    self->_searchSection->invalidateApplication ( app );
 
+    // Tile of a section which is not shown repaints the same pixels
+    self->_scene->invalidate ( app->x(), app->y(),
+                                                  Application::width(), Application::height() );
+}
 
 void LauncherWindow::onIdle()
 {
-    if ( _repaintOnIdle )
-    {
+    if ( _shown && ( _scene->damaged() || _panelDirty || _panelSection != _currentSection ) )
         paint();
-        _repaintOnIdle = false;
-    }
+}
 
-    // check if the application menu file has been changed
-    if ( ! _shown && MenuReader::getInstance()->hasChange())
+void LauncherWindow::onMenuChange()
+{
+    // Sections must not change under user's finger
+    if ( _shown )
     {
-        printf("menu file has changed\n");
+        _menuReloadPending = true;
+        return;
+    }
+
+    printf("menu file has changed\n");
+    _panelDirty = true;
 //        delete _sections;
 
-        /*_sections = */MenuReader::getInstance()->processMenu();
-        _currentSection = 0;
+    /*_sections = */MenuReader::getInstance()->processMenu();
+    _currentSection = 0;
 
-        redrawSections();
-    }
+    redrawSections();
+
+    _menuReloadPending = false;
 }
 
 void LauncherWindow::recreateBuffer()
@@ -698,6 +1058,7 @@ void LauncherWindow::recreateBuffer()
         delete _buffer;
 
     _buffer = new Image(_dpy, _width, _height, DefaultDepth(_dpy, DefaultScreen(_dpy)));
+    _scene->setBuffer(_buffer);
 }
 
 
@@ -712,7 +1073,7 @@ int checkpng(const struct dirent *ent)
 void LauncherWindow::buildCategoryIconsBar()
 {
     delete _categoryIconsBar;
-    for (LinkedList<Image*>::Iter i = _categoryIcons.head(); i; ++i)
+    for (Vector<Image*>::Iter i = _categoryIcons.head(); i; ++i)
         delete (*i);
     _categoryIcons.clear();
 
@@ -767,14 +1128,22 @@ void LauncherWindow::buildCategoryIconsBar()
         XftDrawDestroy(xftDraw);
 
 
+        char **filenames = new char*[count];
+        for (int i = 0; i < count; i++)
+        {
+            filenames[i] = new char[strlen(dirname) + 1 + strlen(namelist[i]->d_name) + 1];
+            strcpy(filenames[i], dirname);
+            strcat(filenames[i], "/");
+            strcat(filenames[i], namelist[i]->d_name);
+
+            // Decoding all icons in parallel
+            ImageLoader::instance()->prefetch(filenames[i]);
+        }
+
         for (int i = 0; i < count; i++)
         {
-            char *filename = new char[strlen(dirname) + 1 + strlen(namelist[i]->d_name) + 1];
-            strcpy(filename, dirname);
-            strcat(filename, "/");
-            strcat(filename, namelist[i]->d_name);
-            Image *icon = new Image(_dpy, filename);
-            delete[] filename;
+            Image *icon = new Image(_dpy, filenames[i]);
+            delete[] filenames[i];
 
             int x = (iconwidth - icon->width()) / 2;
             int y = (_categoryIconsBar->height() - icon->height()) / 2;
@@ -791,6 +1160,7 @@ void LauncherWindow::buildCategoryIconsBar()
             _categoryIcons.append(icon);
         }
 
+        delete[] filenames;
         free(namelist);
     }
 }
@@ -28,7 +28,8 @@
 #include <Imlib2.h>
 #include "SectionList.h"
 
-#include "LinkedList.h"
+#include "Vector.h"
+#include "Scene.h"
 
 #include "XEventHandler.h"
 #include "XIdleTask.h"
@@ -56,6 +57,17 @@ private:
 
     Image *_buffer;
 
+    // Wallpaper, page of shown section, panel and category icons bar
+    Scene *_scene;
+    WallpaperNode _wallpaperNode;
+    DelegateNode _pageNode;
+    DelegateNode _panelNode;
+    DelegateNode _categoryIconsBarNode;
+    void layoutNodes();
+    void drawPage(Picture dest);
+    void drawPanel(Picture dest);
+    void drawCategoryIconsBar(Picture dest);
+
 //    SectionList *_sections;
     uint _currentSection;
 
@@ -67,26 +79,54 @@ private:
     Image* _panelFocusRight;
     Image* _panelFocusMiddle;
 
-    bool _categoryIconsBarVisible;
+    // Panel is redrawn only when current section or section list changes
+    bool _panelDirty;
+    uint _panelSection;
+    void redrawPanel();
+    void redrawSearchPanel();
+
     Image* _categoryIconsBar;
-    LinkedList<Image*> _categoryIcons;
+    Vector<Image*> _categoryIcons;
 
     Timeout *_longtapTimeout;
     void onLongTap(Timeout* timeout);
 
+    // Swipe animation slides page of _swipeFrom section out and page of
+    // current section in
+    Timeout *_swipeTimeout;
+    double _swipeStart;
+    uint _swipeFrom;
+    int _swipeDirection;    // 1 towards next section, -1 towards previous, 0 if not swiping
+    void startSwipe(uint from, int direction);
+    void stopSwipe();
+    void onSwipeFrame(Timeout* timeout);
+
+    int _pressX, _pressY;
+
+    // Type-to-search shows matching applications in place of current
+    // section. Results reuse tiles of the applications.
+    bool _searching;
+    GString *_searchQuery;
+    GPtrArray *_searchResults;
+    Section *_searchSection;
+    void updateSearch();
+    void stopSearch();
+    Section *shownSection();
+
     XftDraw *_xftDraw;
     XftFont *_xftFont;
 
 
     bool _ignoreNextButtonRelease;
-    bool _repaintOnIdle;
+    static void onTileChanged(Application *app, void *data);
+
+    bool _menuReloadPending;
+    void onMenuChange();
 
     void reloadBackground();
     void recreateBuffer();
     void redrawSections();
 
-    void blitBuffer();
-
     void showNotification(const char *message);
 
     void _goPrevious();
@@ -116,6 +156,7 @@ public:
     bool shown();
     void quit();
 
+    // Draws invalidated part of the window
     void paint();
 
     virtual void onIdle();
@@ -21,12 +21,15 @@
 #include "DBus.h"
 
 #include "XEventLoop.h"
+#include "ImageLoader.h"
+#include "Trace.h"
 
 
 #ifdef LAUNCHER
     #include "LauncherWindow.h"
     #include "SectionList.h"
     #include "MenuReader.h"
+    #include "IconIndex.h"
 #endif
 
 
@@ -53,6 +56,9 @@ int main(int argc, char *argv[])
     sigaction(SIGCHLD, &act, 0);
 
 
+    Trace::init();
+
+
     // prepare i8n
     setlocale(LC_ALL,"");
     bindtextdomain("maemo-af-desktop","/usr/share/locale");
@@ -80,6 +86,12 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (! XTools::checkXFixesExtension())
+    {
+        fprintf(stderr, "XServer doesn't support XFixes\n");
+        return 1;
+    }
+
     if (! XTools::checkXRenderExtension())
     {
         fprintf(stderr, "XServer doesn't support XRender\n");
@@ -92,16 +104,18 @@ int main(int argc, char *argv[])
 
     Settings *settings = new Settings;
 
-    // init resource
-    Resources * resources = new Resources(dpy);
+    XEventLoop *eventLoop = new XEventLoop(dpy);
 
+    ImageLoader *imageLoader = new ImageLoader(dpy);
 
-    XEventLoop *eventLoop = new XEventLoop(dpy);
+    // init resource
+    Resources * resources = new Resources(dpy);
 
 
     TeleWindow *teleWindow = new TeleWindow(dpy);
 
     #ifdef LAUNCHER
+        IconIndex *iconIndex = new IconIndex();
         MenuReader *menuReader = new MenuReader(dpy);
         LauncherWindow *launcherWindow = 0;
         if (! settings->disableLauncher())
@@ -117,19 +131,24 @@ int main(int argc, char *argv[])
 
     eventLoop->eventLoop();
 
-    delete eventLoop;
-
+    // Reverse order of creation: everything cancels its timeouts and fd
+    // watches, applications cancel their icon requests
     delete dbus;
 
-    delete teleWindow;
-
     #ifdef LAUNCHER
         delete launcherWindow;
         delete menuReader;
+        delete iconIndex;
     #endif
 
+    delete teleWindow;
+
     delete resources;
+    delete imageLoader;
+    delete eventLoop;
     delete settings;
 
     XCloseDisplay(dpy);
+
+    Trace::done();
 }
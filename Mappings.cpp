@@ -9,6 +9,7 @@
 
 #include "Mappings.h"
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -58,7 +59,7 @@ void Mappings::loadMappings()
 
 Mappings::~Mappings()
 {
-    for (LinkedList<Mapping*>::Iter i = _mappings.head(); i; ++i)
+    for (Vector<Mapping*>::Iter i = _mappings.head(); i; ++i)
         delete (*i);
 }
 
@@ -66,6 +67,6 @@ Mappings::~Mappings()
 
 void Mappings::handleEvent(TeleWindow *teleWindow, Mapping::Event event, KeyCode keyCode)
 {
-    for (LinkedList<Mapping*>::Iter i = _mappings.head(); i; ++i)
+    for (Vector<Mapping*>::Iter i = _mappings.head(); i; ++i)
         (*i)->handleEvent(teleWindow, event, keyCode);
 }
@@ -14,7 +14,7 @@
 
 #include <X11/Xlib.h>
 
-#include "LinkedList.h"
+#include "Vector.h"
 #include "Mapping.h"
 
 class TeleWindow;
@@ -26,7 +26,7 @@ class Mappings
 
         Display *_dpy;
 
-        LinkedList<Mapping*> _mappings;
+        Vector<Mapping*> _mappings;
 
 
         void loadMappings();
@@ -21,8 +21,11 @@
 #include <string.h>
 #include <glib.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/inotify.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include <glib.h>
 
@@ -30,10 +33,15 @@
 #include "constant.h"
 
 #include "Image.h"
+#include "XEventLoop.h"
 
 #define EVENT_SIZE  ( sizeof (struct inotify_event) )
 #define BUF_LEN     ( 1024 * ( EVENT_SIZE + 16 ) )
 
+// Package installation touches many files in a row, reloading only after
+// they stop changing for this long (seconds)
+#define RELOAD_DELAY    1.0
+
 gboolean newSection = FALSE;
 gboolean newApplication = FALSE;
 
@@ -124,8 +132,19 @@ MenuReader::MenuReader(Display *dpy)
 {
     _instance = this;
     _dpy = dpy;
+    _list = NULL;
     _init();
 
+    _applications = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+    _changedFiles = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, NULL );
+    _staleApplications = g_ptr_array_new();
+    _generation = 0;
+
+    _desktopCache.load();
+    _desktopCacheDirty = false;
+
+    _reloadTimeout = 0;
+
     _fd = inotify_init();
     _applicationMenuWD = -1;
     _desktopsFileWD = -1;
@@ -142,6 +161,11 @@ MenuReader::MenuReader(Display *dpy)
 
     if ( _desktopsFileWD < 0)
           printf ("error watching desktop file path\n");
+
+        // Event loop tells us when there is something to read
+        fcntl( _fd, F_SETFL, O_NONBLOCK );
+        fcntl( _fd, F_SETFD, FD_CLOEXEC );
+        XEventLoop::instance()->addFdWatch( _fd, Delegate( this, &MenuReader::onInotify ) );
     }
 }
 
@@ -150,6 +174,20 @@ MenuReader::~MenuReader()
     g_log(G_LOG_DOMAIN, G_LOG_LEVEL_INFO, "MenuReader dtor");
     _cleanup();
 
+    g_hash_table_foreach_remove ( _applications, dropApplication, NULL );
+    g_hash_table_destroy ( _applications );
+    g_hash_table_destroy ( _changedFiles );
+
+    for ( guint i = 0; i < _staleApplications->len; i++ )
+        delete (Application*) g_ptr_array_index ( _staleApplications, i );
+    g_ptr_array_free ( _staleApplications, TRUE );
+
+    if ( _reloadTimeout )
+        XEventLoop::instance()->cancelTimeout( _reloadTimeout );
+
+    if ( _fd >= 0 )
+        XEventLoop::instance()->removeFdWatch( _fd );
+
    ( void ) inotify_rm_watch( _fd, _applicationMenuWD );
    ( void ) inotify_rm_watch( _fd, _desktopsFileWD );
    ( void ) close( _fd );
@@ -214,7 +252,7 @@ void MenuReader::addApplication(const gchar *desktopFilename, bool isExtra)
             _extraSection = _currentSection;
     }
 
-    Application *app = new Application(_dpy, desktopFilename);
+    Application *app = cachedApplication(desktopFilename);
 
     // remove them from the list of desktop files
     if ( ! isExtra )
@@ -222,8 +260,198 @@ void MenuReader::addApplication(const gchar *desktopFilename, bool isExtra)
 
     if(app->isValid())
         _currentSection->addApplication(app);
+}
+
+static time_t desktopFileMtime(const gchar *desktopFilename)
+{
+    gchar *path = g_strconcat ( DESKTOP_FILE_PATH, desktopFilename, NULL );
+
+    struct stat st;
+    time_t mtime = stat ( path, &st ) == 0 ? st.st_mtime : 0;
+
+    g_free ( path );
+    return mtime;
+}
+
+Application * MenuReader::cachedApplication(const gchar *desktopFilename)
+{
+    CachedApplication *cached = (CachedApplication *) g_hash_table_lookup ( _applications, desktopFilename );
+
+    bool changed = _desktopsFileWD >= 0 &&
+        g_hash_table_lookup ( _changedFiles, desktopFilename ) != NULL;
+
+    if ( cached != NULL )
+    {
+        // Without inotify we can only rely on modification times. File
+        // listed in several folders is parsed only for the first of them
+        bool stale;
+        if ( cached->generation == _generation )
+            stale = false;
+        else if ( _desktopsFileWD >= 0 )
+            stale = changed;
+        else
+            stale = desktopFileMtime ( desktopFilename ) != cached->mtime;
+
+        if ( stale )
+        {
+            // Sections of the previous list still refer to it. It is freed
+            // after the new list is built, so the new application can't
+            // get its address and pass for it
+            g_ptr_array_add ( _staleApplications, cached->app );
+            delete cached;
+            g_hash_table_remove ( _applications, desktopFilename );
+            cached = NULL;
+        }
+    }
+
+    if ( cached == NULL )
+    {
+        time_t mtime = desktopFileMtime ( desktopFilename );
+
+        cached = new CachedApplication;
+        cached->mtime = mtime;
+
+        // Mtime has one second resolution, edit made within the same
+        // second as the cached record would be missed
+        DesktopEntry entry;
+        if ( ! changed && _desktopCache.lookup ( desktopFilename, mtime, &entry ) )
+            cached->app = new Application ( _dpy, &entry );
+        else
+        {
+            cached->app = new Application ( _dpy, desktopFilename );
+            _desktopCacheDirty = true;
+        }
+
+        g_hash_table_insert ( _applications, g_strdup ( desktopFilename ), cached );
+    }
+
+    cached->generation = _generation;
+    return cached->app;
+}
+
+gboolean MenuReader::dropApplication(gpointer key, gpointer value, gpointer data)
+{
+    CachedApplication *cached = (CachedApplication *) value;
+    MenuReader *reader = (MenuReader *) data;
+
+    // Keeping applications used by the current menu
+    if ( reader != NULL && cached->generation == reader->_generation )
+        return FALSE;
+
+    if ( reader != NULL )
+        g_ptr_array_add ( reader->_staleApplications, cached->app );
     else
+        delete cached->app;
+    delete cached;
+    return TRUE;
+}
+
+void MenuReader::freeStaleApplications()
+{
+    for ( guint i = 0; i < _staleApplications->len; i++ )
+    {
+        Application *app = (Application*) g_ptr_array_index ( _staleApplications, i );
+
+        // Pages taken from the old sections must not match a later
+        // application allocated at the same address
+        for ( guint j = 0; j < _list->getSize(); j++ )
+            _list->get(j)->invalidateApplication ( app );
+
         delete app;
+    }
+
+    g_ptr_array_set_size ( _staleApplications, 0 );
+}
+
+void MenuReader::restoreList(SectionList *oldList)
+{
+    // Nothing better than an empty menu on the first read
+    if ( oldList == NULL )
+        return;
+
+    _cleanup();
+    _list = oldList;
+    _currentSection = NULL;
+    _extraSection = NULL;
+    _originExtraSection = NULL;
+
+    // Applications replaced meanwhile stay alive, old sections refer to
+    // them. They are freed by the next successful reload
+}
+
+void MenuReader::addToDesktopCache(gpointer key, gpointer value, gpointer data)
+{
+    CachedApplication *cached = (CachedApplication *) value;
+    DesktopCache *cache = (DesktopCache *) data;
+
+    DesktopEntry entry;
+    cached->app->describe ( &entry );
+    entry.filename = (const gchar *) key;
+    entry.mtime = cached->mtime;
+
+    cache->add ( &entry );
+}
+
+void MenuReader::saveDesktopCache()
+{
+    g_hash_table_foreach ( _applications, addToDesktopCache, &_desktopCache );
+    _desktopCache.save();
+
+    _desktopCacheDirty = false;
+}
+
+void MenuReader::addToSearchIndex(gpointer key, gpointer value, gpointer data)
+{
+    CachedApplication *cached = (CachedApplication *) value;
+    SearchIndex *index = (SearchIndex *) data;
+
+    if ( cached->app->isValid() )
+        index->add ( cached->app );
+}
+
+void MenuReader::reuseSections(SectionList *oldList)
+{
+    // Untouched sections keep their icons and do not need to be recreated
+    for ( guint i = 0; i < _list->getSize(); i++ )
+    {
+        Section *section = _list->get(i);
+
+        for ( guint j = 0; j < oldList->getSize(); j++ )
+        {
+            Section *oldSection = oldList->get(j);
+            if ( oldSection == NULL || ! section->hasSameContents ( oldSection ) )
+                continue;
+
+            if ( _extraSection == section )
+                _extraSection = oldSection;
+            if ( _originExtraSection == section )
+                _originExtraSection = oldSection;
+            if ( _currentSection == section )
+                _currentSection = oldSection;
+
+            _list->set ( i, oldSection );
+            oldList->set ( j, NULL );
+            delete section;
+            break;
+        }
+    }
+
+    // Changed sections redraw only changed tiles on the old page
+    for ( guint i = 0; i < _list->getSize(); i++ )
+    {
+        Section *section = _list->get(i);
+
+        for ( guint j = 0; j < oldList->getSize(); j++ )
+        {
+            Section *oldSection = oldList->get(j);
+            if ( oldSection != NULL && oldSection->getPart() == section->getPart() &&
+                 strcmp ( oldSection->getName(), section->getName() ) == 0 )
+            {
+                section->takePage ( oldSection );
+                break;
+            }
+        }
+    }
 }
 
 void MenuReader::setCurrentSectionAsCatchAll()
@@ -284,9 +512,13 @@ void MenuReader::_getDesktopFiles()
 
 SectionList * MenuReader::processMenu()
 {
-    _cleanup();
+    // Sections of the previous menu are reused if they did not change
+    SectionList *oldList = _list;
+    _list = NULL;
     _init();
 
+    _generation++;
+
     _getDesktopFiles();
 
     char *text;
@@ -301,6 +533,7 @@ SectionList * MenuReader::processMenu()
 
     if (g_file_get_contents (APPLICATION_MENU, &text, &length, NULL) == FALSE) {
         if (g_file_get_contents (APPLICATION_MENU_STOCK, &text, &length, NULL) == FALSE) {
+            restoreList(oldList);
             return NULL;
         }
     }
@@ -314,10 +547,16 @@ SectionList * MenuReader::processMenu()
         _init();
 
         if (g_file_get_contents(APPLICATION_MENU_STOCK, &text, &length, NULL) == FALSE)
+        {
+            restoreList(oldList);
             return NULL;
+        }
 
         if (g_markup_parse_context_parse(context, text, length, NULL) == FALSE || _list->getSize() == 0)
+        {
+            restoreList(oldList);
             return NULL;
+        }
     }
 
     printf("Number of launcher sections = %d\n", _list->getSize());
@@ -342,6 +581,24 @@ SectionList * MenuReader::processMenu()
 
     g_hash_table_destroy(_table);
 
+    if ( oldList != NULL )
+    {
+        reuseSections ( oldList );
+        delete oldList;
+    }
+
+    // Forgetting applications which are not in the menu anymore
+    g_hash_table_foreach_remove ( _applications, dropApplication, this );
+    g_hash_table_remove_all ( _changedFiles );
+    freeStaleApplications();
+
+    // Cache also has to forget removed files
+    if ( _desktopCacheDirty || g_hash_table_size ( _applications ) != _desktopCache.size() )
+        saveDesktopCache();
+
+    _searchIndex.clear();
+    g_hash_table_foreach ( _applications, addToSearchIndex, &_searchIndex );
+    _searchIndex.finish();
 
     assignSectionIcons();
 
@@ -349,54 +606,54 @@ SectionList * MenuReader::processMenu()
     return _list;
 }
 
-bool MenuReader::hasChange()
+void MenuReader::onInotify(int fd)
 {
-    if (_fd < 0 ) return FALSE;
-
-    struct timeval time;
-    fd_set rfds;
-    int ret;
+    bool changed = false;
 
-    time.tv_sec = 0;
-    time.tv_usec = 100;
-
-    /* zero-out the fd_set */
-    FD_ZERO (&rfds);
-
-    FD_SET (_fd, &rfds);
-
-    ret = select (_fd + 1, &rfds, NULL, NULL, &time);
-    if (ret < 0)
-        return FALSE;
-    else if (!ret)
-        return FALSE;
-    else if (FD_ISSET (_fd, &rfds) )
+    /* inotify events are available! Reading everything queued */
+    char buffer[BUF_LEN];
+    int length;
+    while ( ( length = read( fd, buffer, BUF_LEN ) ) > 0 )
     {
-        /* inotify events are available! */
-        int length, i = 0;
-        char buffer[BUF_LEN];
-
-        length = read( _fd, buffer, BUF_LEN );
-        if ( length < 0 )
-            return FALSE;
-
+        int i = 0;
         while ( i < length )
         {
             struct inotify_event *event = ( struct inotify_event * ) &buffer[ i ];
 
             if ( event->wd == _applicationMenuWD && event->mask & IN_MODIFY )
+                changed = true;
+            else if ( event->wd == _desktopsFileWD )
             {
-                return TRUE;
+                changed = true;
+
+                // Only these files will be parsed again on reload
+                if ( event->len > 0 )
+                    g_hash_table_replace ( _changedFiles, g_strdup ( event->name ), GINT_TO_POINTER ( 1 ) );
             }
-            else if ( event->wd == _desktopsFileWD )
-        {
-            return TRUE;
-        }
 
             i += EVENT_SIZE + event->len;
         }
     }
-    return FALSE;
+
+    if ( length < 0 && errno != EAGAIN )
+        perror( "read(inotify)" );
+
+    if ( ! changed )
+        return;
+
+    // Restarting the delay on each change
+    if ( _reloadTimeout )
+        XEventLoop::instance()->cancelTimeout( _reloadTimeout );
+    _reloadTimeout = XEventLoop::instance()->addTimeout( RELOAD_DELAY,
+        Delegate( this, &MenuReader::onReloadTimeout ) );
+}
+
+void MenuReader::onReloadTimeout(Timeout *timeout)
+{
+    _reloadTimeout = 0;
+
+    if ( ! _onChange.empty() )
+        _onChange();
 }
 
 
@@ -408,6 +665,10 @@ void MenuReader::assignSectionIcons()
 
     for (unsigned int i = 0; i < _list->getSize(); i++)
     {
+        // Reused sections already have their icons
+        if (_list->get(i)->getIcon() != 0)
+            continue;
+
         char *iconfile = g_key_file_get_string(kfile, "Icons", _list->get(i)->getName(), 0);
         if (iconfile)
         {
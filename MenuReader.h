@@ -21,7 +21,14 @@
 #ifndef MENUREADER_H
 #define MENUREADER_H
 
+#include <time.h>
+
 #include "SectionList.h"
+#include "DesktopCache.h"
+#include "SearchIndex.h"
+#include "Delegate.h"
+
+class Timeout;
 
 class MenuReader
 {
@@ -34,10 +41,15 @@ public:
     void addApplication(const gchar *desktopFilename, bool isExtra = false);
     void endSection();
     void setCurrentSectionAsCatchAll();
-    bool hasChange();
+
+    // Called once menu files stop changing
+    void setOnChange(Delegate0<> onChange) { _onChange = onChange; }
 
     SectionList *sectionList() { return _list; }
 
+    // Applications of the current menu
+    SearchIndex *searchIndex() { return &_searchIndex; }
+
 protected:
     void _init();
     void _cleanup();
@@ -56,6 +68,40 @@ private:
     int _desktopsFileWD;
     GHashTable * _table;
 
+    // Parsed .desktop files survive reloads, only changed ones are
+    // parsed again. Sections do not own their applications, we do.
+    struct CachedApplication
+    {
+        Application *app;
+        time_t mtime;
+        guint generation;   // last reload which used this application
+    };
+    GHashTable * _applications;     // desktop file name -> CachedApplication
+    GHashTable * _changedFiles;     // desktop files touched since last reload
+    GPtrArray * _staleApplications; // replaced or dropped, freed after reload
+    guint _generation;
+
+    // Parsed entries for the next startup
+    DesktopCache _desktopCache;
+    bool _desktopCacheDirty;
+    void saveDesktopCache();
+    static void addToDesktopCache(gpointer key, gpointer value, gpointer data);
+
+    SearchIndex _searchIndex;
+    static void addToSearchIndex(gpointer key, gpointer value, gpointer data);
+
+    Application * cachedApplication(const gchar *desktopFilename);
+    static gboolean dropApplication(gpointer key, gpointer value, gpointer data);
+    void freeStaleApplications();
+    void restoreList(SectionList *oldList);
+    void reuseSections(SectionList *oldList);
+
+    Delegate0<> _onChange;
+    Timeout *_reloadTimeout;
+
+    void onInotify(int fd);
+    void onReloadTimeout(Timeout *timeout);
+
     void assignSectionIcons();
     static void saveSectionIcon(Section *section, void *data);
 };
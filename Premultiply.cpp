@@ -0,0 +1,155 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+#include "Premultiply.h"
+
+#ifdef PREMULTIPLY_X86
+    #include <immintrin.h>
+#endif
+
+
+Premultiply::Kernel Premultiply::_kernel = Premultiply::chooseKernel();
+const char* Premultiply::_kernelName;
+
+
+// c * a / 255 rounded to nearest, without division
+static inline unsigned int mul255(unsigned int c, unsigned int a)
+{
+    unsigned int t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+
+void Premultiply::scalar(unsigned int *pixels, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        unsigned int p = pixels[i];
+        unsigned int a = p >> 24;
+        if (a == 0xff)
+            continue;
+
+        pixels[i] = a << 24 |
+            mul255(p >> 16 & 0xff, a) << 16 |
+            mul255(p >>  8 & 0xff, a) <<  8 |
+            mul255(p       & 0xff, a);
+    }
+}
+
+
+#ifdef PREMULTIPLY_X86
+
+// Pixels are little-endian here, so 16-bit lanes of unpacked pixel are
+// B, G, R, A. Alpha is broadcast to all four lanes, and its own lane gets
+// multiplier 255, which keeps it unchanged.
+
+__attribute__((target("sse2")))
+static inline __m128i premultiplyHalfSSE2(__m128i px)
+{
+    const __m128i keepAlpha = _mm_set_epi16(0xff, 0, 0, 0, 0xff, 0, 0, 0);
+    const __m128i round = _mm_set1_epi16(128);
+
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xff), 0xff);
+    alpha = _mm_or_si128(alpha, keepAlpha);
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, alpha), round);
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+void Premultiply::sse2(unsigned int *pixels, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i*)(pixels + i));
+
+        __m128i lo = premultiplyHalfSSE2(_mm_unpacklo_epi8(px, zero));
+        __m128i hi = premultiplyHalfSSE2(_mm_unpackhi_epi8(px, zero));
+
+        _mm_storeu_si128((__m128i*)(pixels + i), _mm_packus_epi16(lo, hi));
+    }
+
+    scalar(pixels + i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static inline __m256i premultiplyHalfAVX2(__m256i px)
+{
+    const __m256i keepAlpha = _mm256_set_epi16(
+        0xff, 0, 0, 0, 0xff, 0, 0, 0,
+        0xff, 0, 0, 0, 0xff, 0, 0, 0);
+    const __m256i round = _mm256_set1_epi16(128);
+
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px, 0xff), 0xff);
+    alpha = _mm256_or_si256(alpha, keepAlpha);
+
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, alpha), round);
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+void Premultiply::avx2(unsigned int *pixels, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i px = _mm256_loadu_si256((const __m256i*)(pixels + i));
+
+        // Unpacking and packing work inside 128-bit halves, so pixels
+        // return to their places
+        __m256i lo = premultiplyHalfAVX2(_mm256_unpacklo_epi8(px, zero));
+        __m256i hi = premultiplyHalfAVX2(_mm256_unpackhi_epi8(px, zero));
+
+        _mm256_storeu_si256((__m256i*)(pixels + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    sse2(pixels + i, count - i);
+}
+
+
+bool Premultiply::haveSSE2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+bool Premultiply::haveAVX2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+
+Premultiply::Kernel Premultiply::chooseKernel()
+{
+#ifdef PREMULTIPLY_X86
+    if (haveAVX2())
+    {
+        _kernelName = "avx2";
+        return avx2;
+    }
+
+    if (haveSSE2())
+    {
+        _kernelName = "sse2";
+        return sse2;
+    }
+#endif
+
+    _kernelName = "scalar";
+    return scalar;
+}
@@ -0,0 +1,50 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+// Premultiply - converts ARGB32 pixels to premultiplied alpha in place
+//
+// premultiply() picks the fastest variant supported by the CPU at
+// startup: AVX2 or SSE2 on x86, plain C elsewhere. All variants give
+// exactly the same result, c * a / 255 rounded to nearest.
+
+#ifndef __TELESCOPE_PREMULTIPLY_H
+#define __TELESCOPE_PREMULTIPLY_H
+
+#if defined(__i386__) || defined(__x86_64__)
+    #define PREMULTIPLY_X86
+#endif
+
+class Premultiply
+{
+    private:
+        typedef void (*Kernel)(unsigned int *pixels, int count);
+
+        static Kernel _kernel;
+        static const char *_kernelName;
+
+        static Kernel chooseKernel();
+
+    public:
+        static void premultiply(unsigned int *pixels, int count)
+        { _kernel(pixels, count); }
+
+        // Name of the variant used by premultiply()
+        static const char* implementation() { return _kernelName; }
+
+        // Separate variants, for benchmarking
+        static void scalar(unsigned int *pixels, int count);
+#ifdef PREMULTIPLY_X86
+        static bool haveSSE2();
+        static bool haveAVX2();
+        static void sse2(unsigned int *pixels, int count);
+        static void avx2(unsigned int *pixels, int count);
+#endif
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include "Resources.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <Imlib2.h>
@@ -21,6 +22,7 @@
 #include "Settings.h"
 
 #include "Image.h"
+#include "ImageLoader.h"
 
 Resources* Resources::_instance = 0;
 
@@ -33,6 +35,23 @@ Resources::Resources(Display *dpy): _dpy(dpy)
     _instance = this;
 
     _wallpaper = 0;
+    _wallpaperSource = 0;
+    _wallpaperSourceFilename = 0;
+    _wallpaperSourceMtime = 0;
+
+
+    // Decoding all files in parallel, constructors below pick the results
+    ImageLoader *loader = ImageLoader::instance();
+    if (Settings::instance()->backgroundFilename())
+        loader->prefetch(Settings::instance()->backgroundFilename(), false);
+    loader->prefetch(Settings::instance()->headerLeftFilename());
+    loader->prefetch(Settings::instance()->headerRightFilename());
+    loader->prefetch(Settings::instance()->headerMiddleFilename());
+    loader->prefetch(Settings::instance()->headerLeftSelectedFilename());
+    loader->prefetch(Settings::instance()->headerRightSelectedFilename());
+    loader->prefetch(Settings::instance()->headerMiddleSelectedFilename());
+    loader->prefetch(Settings::instance()->brokenPatternFilename());
+    loader->prefetch(Settings::instance()->textBackgroundFilename());
 
 
 // Loading header images
@@ -75,6 +94,34 @@ Resources::~Resources()
     delete _textBackground;
 
     delete _wallpaper;
+    delete _wallpaperSource;
+    free(_wallpaperSourceFilename);
+}
+
+
+DecodedImage* Resources::wallpaperSource()
+{
+    const char *filename = Settings::instance()->backgroundFilename();
+    if (filename == 0)
+        return 0;
+
+    struct stat st;
+    time_t mtime = stat(filename, &st) == 0 ? st.st_mtime : 0;
+
+    if (_wallpaperSource != 0 && strcmp(_wallpaperSourceFilename, filename) == 0 &&
+        _wallpaperSourceMtime == mtime)
+        return _wallpaperSource;
+
+    delete _wallpaperSource;
+    free(_wallpaperSourceFilename);
+
+    _wallpaperSourceFilename = strdup(filename);
+    _wallpaperSourceMtime = mtime;
+
+    // Not premultiplied, imlib wants straight alpha
+    _wallpaperSource = ImageLoader::instance()->take(filename, false);
+
+    return _wallpaperSource;
 }
 
 
@@ -82,8 +129,7 @@ Resources::~Resources()
 
 void Resources::reloadWallpaper()
 {
-    if (!_wallpaper)
-        delete _wallpaper;
+    delete _wallpaper;
 
     Window rootWindow = XTools::rootWindow();
     XWindowAttributes attrs;
@@ -100,7 +146,17 @@ void Resources::reloadWallpaper()
 
     int bgXpos = 0;
     int bgYpos = 0;
-    Imlib_Image background = imlib_load_image(Settings::instance()->backgroundFilename());
+    Imlib_Image background = 0;
+
+    DecodedImage *source = wallpaperSource();
+    if (source != 0)
+    {
+        // Imlib neither copies nor frees these pixels
+        background = imlib_create_image_using_data(source->width, source->height, (DATA32*)source->pixels);
+        imlib_context_set_image(background);
+        imlib_image_set_has_alpha(1);
+    }
+
     if (background == 0)
     {
         printf("Cannot load background\n");
@@ -14,10 +14,13 @@
 #ifndef __TELESCOPE__RESOURCES_H
 #define __TELESCOPE__RESOURCES_H
 
+#include <time.h>
+
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrender.h>
 
 class Image;
+struct DecodedImage;
 
 
 class Resources
@@ -45,6 +48,12 @@ class Resources
 
         Image* _wallpaper;
 
+        // Decoded wallpaper file, rotation only rescales it
+        DecodedImage* _wallpaperSource;
+        char* _wallpaperSourceFilename;
+        time_t _wallpaperSourceMtime;
+        DecodedImage* wallpaperSource();
+
     public:
         Resources(Display *dpy);
         ~Resources();
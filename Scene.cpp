@@ -0,0 +1,356 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+#include "Scene.h"
+
+#include "Image.h"
+#include "Resources.h"
+
+
+SceneNode::SceneNode()
+    : _scene(0), _x(0), _y(0), _width(0), _height(0), _visible(true)
+{
+}
+
+
+SceneNode::~SceneNode()
+{
+    if (_scene)
+        _scene->remove(this);
+}
+
+
+void SceneNode::setGeometry(int x, int y, int width, int height)
+{
+    if (x == _x && y == _y && width == _width && height == _height)
+        return;
+
+    invalidate();
+
+    _x = x;
+    _y = y;
+    _width = width;
+    _height = height;
+
+    invalidate();
+}
+
+
+void SceneNode::setVisible(bool visible)
+{
+    if (visible == _visible)
+        return;
+
+    // Invisible node does not invalidate anything
+    if (_visible)
+        invalidate();
+
+    _visible = visible;
+
+    invalidate();
+}
+
+
+void SceneNode::invalidate()
+{
+    if (_scene && _visible)
+        _scene->invalidate(_x, _y, _width, _height);
+}
+
+
+
+void WallpaperNode::draw(Picture dest)
+{
+    XRenderComposite(Resources::instance()->wallpaper()->display(), PictOpSrc,
+        Resources::instance()->wallpaper()->picture(), None, dest,
+        x(), y(), 0, 0,
+        x(), y(), width(), height()
+    );
+}
+
+
+
+void ClearNode::draw(Picture dest)
+{
+    XRenderColor transparent = { 0, 0, 0, 0 };
+    XRenderFillRectangle(_dpy, PictOpClear, dest, &transparent,
+        x(), y(), width(), height());
+}
+
+
+
+Scene::Scene(Display *dpy, Window win, GC gc)
+    : _dpy(dpy), _win(win), _gc(gc), _buffer(0), _parent(0), _boxesCount(0)
+{
+    _region = XFixesCreateRegion(_dpy, 0, 0);
+    _scratchRegion = XFixesCreateRegion(_dpy, 0, 0);
+}
+
+
+Scene::~Scene()
+{
+    for (Vector<SceneNode*>::Iter i = _nodes.head(); i; ++i)
+        (*i)->_scene = 0;
+
+    XFixesDestroyRegion(_dpy, _scratchRegion);
+    XFixesDestroyRegion(_dpy, _region);
+}
+
+
+void Scene::setBuffer(Image *buffer)
+{
+    _buffer = buffer;
+    invalidateAll();
+}
+
+
+void Scene::add(SceneNode *node)
+{
+    node->_scene = this;
+    _nodes.append(node);
+    node->invalidate();
+}
+
+
+void Scene::remove(SceneNode *node)
+{
+    node->invalidate();
+    node->_scene = 0;
+    _nodes.removeByValue(node);
+}
+
+
+static XRectangle boundingBox(const XRectangle *boxes, int count)
+{
+    int x1 = boxes[0].x, y1 = boxes[0].y;
+    int x2 = x1 + boxes[0].width, y2 = y1 + boxes[0].height;
+
+    for (int i = 1; i < count; ++i)
+    {
+        if (boxes[i].x < x1) x1 = boxes[i].x;
+        if (boxes[i].y < y1) y1 = boxes[i].y;
+        if (boxes[i].x + boxes[i].width > x2) x2 = boxes[i].x + boxes[i].width;
+        if (boxes[i].y + boxes[i].height > y2) y2 = boxes[i].y + boxes[i].height;
+    }
+
+    XRectangle result;
+    result.x = x1;
+    result.y = y1;
+    result.width = x2 - x1;
+    result.height = y2 - y1;
+    return result;
+}
+
+
+void Scene::addBox(const XRectangle &box)
+{
+    // Too fragmented, one bounding box is good enough for culling
+    if (_boxesCount == MAX_BOXES)
+    {
+        _boxes[0] = boundingBox(_boxes, _boxesCount);
+        _boxesCount = 1;
+    }
+
+    _boxes[_boxesCount++] = box;
+}
+
+
+bool Scene::intersects(const SceneNode *node) const
+{
+    for (int i = 0; i < _boxesCount; ++i)
+    {
+        const XRectangle &box = _boxes[i];
+        if (node->x() < box.x + box.width && box.x < node->x() + node->width() &&
+            node->y() < box.y + box.height && box.y < node->y() + node->height())
+            return true;
+    }
+    return false;
+}
+
+
+void Scene::invalidate(int x, int y, int width, int height)
+{
+    if (_buffer == 0)
+        return;
+
+    // Clipping to the window
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (x + width > _buffer->width()) width = _buffer->width() - x;
+    if (y + height > _buffer->height()) height = _buffer->height() - y;
+
+    if (width <= 0 || height <= 0)
+        return;
+
+    XRectangle box;
+    box.x = x;
+    box.y = y;
+    box.width = width;
+    box.height = height;
+    addBox(box);
+
+    XFixesSetRegion(_dpy, _scratchRegion, &box, 1);
+    XFixesUnionRegion(_dpy, _region, _region, _scratchRegion);
+
+    if (_parent)
+        _parent->contentInvalidated(x, y, width, height);
+}
+
+
+void Scene::invalidate(XserverRegion region, const XRectangle &box)
+{
+    if (_buffer == 0)
+        return;
+
+    if (box.x >= _buffer->width() || box.y >= _buffer->height() ||
+        box.x + box.width <= 0 || box.y + box.height <= 0)
+        return;
+
+    addBox(box);
+
+    XFixesCopyRegion(_dpy, _scratchRegion, region);
+    XFixesTranslateRegion(_dpy, _scratchRegion, box.x, box.y);
+    XFixesUnionRegion(_dpy, _region, _region, _scratchRegion);
+
+    if (_parent)
+        _parent->contentInvalidated(region, box);
+}
+
+
+void Scene::invalidateAll()
+{
+    if (_buffer == 0)
+        return;
+
+    _boxesCount = 0;
+    invalidate(0, 0, _buffer->width(), _buffer->height());
+}
+
+
+void Scene::render()
+{
+    if (_buffer == 0 || _boxesCount == 0)
+        return;
+
+    XFixesSetPictureClipRegion(_dpy, _buffer->picture(), 0, 0, _region);
+
+    for (Vector<SceneNode*>::Iter i = _nodes.head(); i; ++i)
+        if ((*i)->visible() && intersects(*i))
+            (*i)->draw(_buffer->picture());
+
+    XFixesSetPictureClipRegion(_dpy, _buffer->picture(), 0, 0, None);
+
+
+    if (_win != None)
+    {
+        XRectangle bounds = boundingBox(_boxes, _boxesCount);
+
+        XFixesSetGCClipRegion(_dpy, _gc, 0, 0, _region);
+        XCopyArea(_dpy, _buffer->pixmap(), _win, _gc,
+            bounds.x, bounds.y, bounds.width, bounds.height,
+            bounds.x, bounds.y
+        );
+        XFixesSetGCClipRegion(_dpy, _gc, 0, 0, None);
+    }
+
+    XFixesSetRegion(_dpy, _region, 0, 0);
+    _boxesCount = 0;
+}
+
+
+
+ScrollNode::ScrollNode(Display *dpy)
+    : _dpy(dpy), _surface(0), _content(dpy, None, 0), _background(dpy),
+      _offsetX(0), _offsetY(0)
+{
+    _content._parent = this;
+    _content.add(&_background);
+}
+
+
+ScrollNode::~ScrollNode()
+{
+    // Nodes leaving content scene must not touch the surface
+    _content._parent = 0;
+    _content.setBuffer(0);
+    delete _surface;
+}
+
+
+void ScrollNode::setSurfaceSize(int width, int height)
+{
+    if (_surface && _surface->width() == width && _surface->height() == height)
+        return;
+
+    delete _surface;
+    _surface = new Image(_dpy, width, height);
+
+    _background.setGeometry(0, 0, width, height);
+    _content.setBuffer(_surface);
+}
+
+
+int ScrollNode::surfaceWidth()
+{
+    return _surface ? _surface->width() : 0;
+}
+
+
+int ScrollNode::surfaceHeight()
+{
+    return _surface ? _surface->height() : 0;
+}
+
+
+void ScrollNode::setOffset(int x, int y)
+{
+    if (x == _offsetX && y == _offsetY)
+        return;
+
+    _offsetX = x;
+    _offsetY = y;
+
+    invalidate();
+}
+
+
+void ScrollNode::contentInvalidated(int x, int y, int width, int height)
+{
+    if (scene() && visible())
+        scene()->invalidate(this->x() + _offsetX + x, this->y() + _offsetY + y, width, height);
+}
+
+
+void ScrollNode::contentInvalidated(XserverRegion region, const XRectangle &box)
+{
+    if (scene() && visible())
+    {
+        XRectangle translated = box;
+        translated.x += this->x() + _offsetX;
+        translated.y += this->y() + _offsetY;
+        scene()->invalidate(region, translated);
+    }
+}
+
+
+void ScrollNode::draw(Picture dest)
+{
+    if (_surface == 0)
+        return;
+
+    // Bringing changed part of the surface up to date
+    _content.render();
+
+    XRenderComposite(_dpy, PictOpOver,
+        _surface->picture(), None, dest,
+        0, 0, 0, 0,
+        x() + _offsetX, y() + _offsetY,
+        _surface->width(), _surface->height()
+    );
+}
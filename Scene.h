@@ -0,0 +1,197 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+// Scene - retained contents of a window
+//
+// Window is a stack of nodes, bottom to top, each with a bounding box in
+// window coordinates. Whatever changes on screen invalidates the area it
+// covers. render() draws only nodes intersecting the invalidated area
+// into the back buffer, clipped to that area, and copies just that area
+// to the window. Nodes must draw with XRender, which respects the clip.
+//
+// Scene without a window only keeps its buffer up to date. ScrollNode
+// uses one for content which is scrolled as a whole.
+
+#ifndef __TELESCOPE_SCENE_H
+#define __TELESCOPE_SCENE_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrender.h>
+#include <X11/extensions/Xfixes.h>
+
+#include "Delegate.h"
+#include "Vector.h"
+
+class Image;
+class Scene;
+class ScrollNode;
+
+
+class SceneNode
+{
+    private:
+        friend class Scene;
+
+        Scene *_scene;
+
+        int _x, _y;
+        int _width, _height;
+        bool _visible;
+
+    protected:
+        Scene* scene() { return _scene; }
+
+    public:
+        SceneNode();
+        // Leaves the scene, invalidating its area
+        virtual ~SceneNode();
+
+        int x() const { return _x; }
+        int y() const { return _y; }
+        int width() const { return _width; }
+        int height() const { return _height; }
+        bool visible() const { return _visible; }
+
+        // Invalidate both old and new area if something changes
+        void setGeometry(int x, int y, int width, int height);
+        void setVisible(bool visible);
+
+        void invalidate();
+
+        // Draws node into the scene buffer, which is already clipped
+        virtual void draw(Picture dest) = 0;
+};
+
+
+// Node drawn by its owner
+class DelegateNode: public SceneNode
+{
+    private:
+        Delegate1<Picture> _draw;
+
+    public:
+        DelegateNode(Delegate1<Picture> draw): _draw(draw) { }
+
+        virtual void draw(Picture dest) { _draw(dest); }
+};
+
+
+// Current wallpaper from Resources, full window
+class WallpaperNode: public SceneNode
+{
+    public:
+        virtual void draw(Picture dest);
+};
+
+
+// Makes its area transparent, bottom of scenes drawn over something else
+class ClearNode: public SceneNode
+{
+    private:
+        Display *_dpy;
+
+    public:
+        ClearNode(Display *dpy): _dpy(dpy) { }
+
+        virtual void draw(Picture dest);
+};
+
+
+class Scene
+{
+    private:
+        friend class ScrollNode;
+
+        Display *_dpy;
+        Window _win;
+        GC _gc;
+        Image *_buffer;
+
+        // Node which shows this scene in another one
+        ScrollNode *_parent;
+
+        Vector<SceneNode*> _nodes;
+
+        // Invalidated area: exact shape on the server and a few bounding
+        // boxes here, used to skip nodes and to limit the final copy
+        XserverRegion _region;
+        XserverRegion _scratchRegion;
+        enum { MAX_BOXES = 16 };
+        XRectangle _boxes[MAX_BOXES];
+        int _boxesCount;
+
+        void addBox(const XRectangle &box);
+        bool intersects(const SceneNode *node) const;
+
+    public:
+        // Buffer is owned by the caller, gc must have graphics exposures
+        // turned off. Window may be None
+        Scene(Display *dpy, Window win, GC gc);
+        ~Scene();
+
+        // Back buffer of window size. Everything gets invalidated
+        void setBuffer(Image *buffer);
+
+        // Nodes are not owned by scene
+        void add(SceneNode *node);
+        void remove(SceneNode *node);
+
+        void invalidate(int x, int y, int width, int height);
+        // Region is in box coordinates, box is its bounding box in window
+        void invalidate(XserverRegion region, const XRectangle &box);
+        void invalidateAll();
+
+        bool damaged() const { return _boxesCount > 0; }
+
+        // Draws and presents the invalidated area
+        void render();
+};
+
+
+// Shows a scene of its own, composed into an offscreen surface, at an
+// offset. Changing the offset costs one composite of the surface, nothing
+// in the content is redrawn. Content is drawn with alpha, whatever is
+// under the node shows through
+class ScrollNode: public SceneNode
+{
+    private:
+        Display *_dpy;
+        Image *_surface;
+        Scene _content;
+        ClearNode _background;
+
+        int _offsetX, _offsetY;
+
+        friend class Scene;
+        // Called by content scene, area is in surface coordinates
+        void contentInvalidated(int x, int y, int width, int height);
+        void contentInvalidated(XserverRegion region, const XRectangle &box);
+
+    public:
+        ScrollNode(Display *dpy);
+        virtual ~ScrollNode();
+
+        // Content nodes are positioned in surface coordinates
+        Scene* content() { return &_content; }
+
+        // Surface is recreated and redrawn only if size changes
+        void setSurfaceSize(int width, int height);
+        int surfaceWidth();
+        int surfaceHeight();
+
+        // Position of surface origin relative to the node
+        void setOffset(int x, int y);
+        int offsetX() const { return _offsetX; }
+        int offsetY() const { return _offsetY; }
+
+        virtual void draw(Picture dest);
+};
+
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ *  Copyright (c) 2010 Andry Gunawan <angun33@gmail.com>
+ *
+ *  Parts of this file are based on Telescope which is
+ *  Copyright (c) 2010 Ilya Skriblovsky <Ilya.Skriblovsky@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+
+#include "SearchIndex.h"
+#include "Application.h"
+
+// Queries shorter than this match only beginnings of words
+#define TRIGRAM_LENGTH  3
+
+#define TRIGRAM(c)  ( ( (guint) (guchar) (c)[0] << 16 ) | ( (guint) (guchar) (c)[1] << 8 ) | (guint) (guchar) (c)[2] )
+
+static gint compareEntryNumbers(gconstpointer a, gconstpointer b)
+{
+    guint x = *(const guint*) a;
+    guint y = *(const guint*) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+SearchIndex::SearchIndex()
+{
+    _entries = g_ptr_array_new();
+    _words = g_array_new ( FALSE, FALSE, sizeof ( Word ) );
+    _trigrams = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, _freePostings );
+    _lastQuery = NULL;
+    _lastMatches = g_array_new ( FALSE, FALSE, sizeof ( guint ) );
+}
+
+SearchIndex::~SearchIndex()
+{
+    clear();
+
+    g_ptr_array_free ( _entries, TRUE );
+    g_array_free ( _words, TRUE );
+    g_hash_table_destroy ( _trigrams );
+    g_array_free ( _lastMatches, TRUE );
+}
+
+void SearchIndex::_freePostings(gpointer postings)
+{
+    g_array_free ( (GArray*) postings, TRUE );
+}
+
+void SearchIndex::clear()
+{
+    for ( guint i = 0; i < _entries->len; i++ )
+    {
+        g_free ( _entry(i)->text );
+        g_free ( _entry(i) );
+    }
+    g_ptr_array_set_size ( _entries, 0 );
+
+    g_array_set_size ( _words, 0 );
+    g_hash_table_remove_all ( _trigrams );
+
+    g_free ( _lastQuery );
+    _lastQuery = NULL;
+    g_array_set_size ( _lastMatches, 0 );
+}
+
+void SearchIndex::add(Application *app)
+{
+    // "/usr/bin/osso-xterm %U" is found as "osso-xterm"
+    gchar *executable = NULL;
+    if ( app->getExecutable() != NULL )
+    {
+        gchar *command = g_strndup ( app->getExecutable(), strcspn ( app->getExecutable(), " \t" ) );
+        gchar *basename = g_path_get_basename ( command );
+        executable = g_ascii_strdown ( basename, -1 );
+        g_free ( basename );
+        g_free ( command );
+    }
+
+    gchar *name = g_utf8_strdown ( app->getApplicationName(), -1 );
+
+    Entry *entry = g_new ( Entry, 1 );
+    entry->app = app;
+    entry->text = g_strconcat ( name, "\n", executable, NULL );
+    entry->nameLength = strlen ( name );
+    g_ptr_array_add ( _entries, entry );
+
+    g_free ( name );
+    g_free ( executable );
+}
+
+void SearchIndex::finish()
+{
+    // Results are collected in entry order, which makes them sorted
+    g_ptr_array_sort ( _entries, _compareEntries );
+
+    for ( guint i = 0; i < _entries->len; i++ )
+    {
+        const gchar *text = _entry(i)->text;
+
+        for ( const gchar *c = text; *c != '\0'; c++ )
+        {
+            if ( _isWordStart ( text, c ) )
+            {
+                Word word = { c, i };
+                g_array_append_val ( _words, word );
+            }
+
+            if ( c[1] == '\0' || c[2] == '\0' )
+                continue;
+
+            gpointer key = GUINT_TO_POINTER ( TRIGRAM ( c ) );
+            GArray *postings = (GArray*) g_hash_table_lookup ( _trigrams, key );
+            if ( postings == NULL )
+            {
+                postings = g_array_new ( FALSE, FALSE, sizeof ( guint ) );
+                g_hash_table_insert ( _trigrams, key, postings );
+            }
+
+            // Entries are added in order, so the list stays sorted
+            if ( postings->len == 0 || g_array_index ( postings, guint, postings->len - 1 ) != i )
+                g_array_append_val ( postings, i );
+        }
+    }
+
+    g_array_sort ( _words, _compareWords );
+}
+
+gint SearchIndex::_compareEntries(gconstpointer a, gconstpointer b)
+{
+    return strcmp ( ( *(Entry* const*) a )->text, ( *(Entry* const*) b )->text );
+}
+
+gint SearchIndex::_compareWords(gconstpointer a, gconstpointer b)
+{
+    return strcmp ( ( (const Word*) a )->start, ( (const Word*) b )->start );
+}
+
+bool SearchIndex::_isWordStart(const gchar *text, const gchar *c)
+{
+    // Non-ASCII characters are taken as letters
+    if ( ! g_ascii_isalnum ( *c ) && ! ( *c & 0x80 ) )
+        return false;
+
+    return c == text || ( ! g_ascii_isalnum ( c[-1] ) && ! ( c[-1] & 0x80 ) );
+}
+
+bool SearchIndex::_matches(guint entry, const gchar *query, guint length)
+{
+    const gchar *text = _entry(entry)->text;
+
+    if ( length >= TRIGRAM_LENGTH )
+        return strstr ( text, query ) != NULL;
+
+    for ( const gchar *c = text; *c != '\0'; c++ )
+    {
+        if ( _isWordStart ( text, c ) && strncmp ( c, query, length ) == 0 )
+            return true;
+    }
+
+    return false;
+}
+
+int SearchIndex::_rank(guint entry, const gchar *query, guint length)
+{
+    const gchar *text = _entry(entry)->text;
+
+    if ( strncmp ( text, query, length ) == 0 )
+        return 0;
+
+    for ( const gchar *c = text; c < text + _entry(entry)->nameLength; c++ )
+    {
+        if ( _isWordStart ( text, c ) && strncmp ( c, query, length ) == 0 )
+            return 1;
+    }
+
+    return 2;
+}
+
+void SearchIndex::_candidates(const gchar *query, guint length, GArray *candidates)
+{
+    if ( length >= TRIGRAM_LENGTH )
+    {
+        // Every match contains all trigrams of the query, the shortest
+        // list of them is enough to check
+        GArray *shortest = NULL;
+        for ( guint i = 0; i + TRIGRAM_LENGTH <= length; i++ )
+        {
+            GArray *postings = (GArray*) g_hash_table_lookup ( _trigrams, GUINT_TO_POINTER ( TRIGRAM ( query + i ) ) );
+            if ( postings == NULL )
+                return;
+
+            if ( shortest == NULL || postings->len < shortest->len )
+                shortest = postings;
+        }
+
+        g_array_append_vals ( candidates, shortest->data, shortest->len );
+        return;
+    }
+
+    // Binary search for the first word starting with the query
+    guint low = 0, high = _words->len;
+    while ( low < high )
+    {
+        guint middle = ( low + high ) / 2;
+        if ( strncmp ( g_array_index ( _words, Word, middle ).start, query, length ) < 0 )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    for ( guint i = low; i < _words->len; i++ )
+    {
+        const Word &word = g_array_index ( _words, Word, i );
+        if ( strncmp ( word.start, query, length ) != 0 )
+            break;
+        g_array_append_val ( candidates, word.entry );
+    }
+
+    // Entry may have several words with this prefix
+    g_array_sort ( candidates, compareEntryNumbers );
+
+    guint count = 0;
+    for ( guint i = 0; i < candidates->len; i++ )
+    {
+        if ( count == 0 || g_array_index ( candidates, guint, count - 1 ) != g_array_index ( candidates, guint, i ) )
+            g_array_index ( candidates, guint, count++ ) = g_array_index ( candidates, guint, i );
+    }
+    g_array_set_size ( candidates, count );
+}
+
+void SearchIndex::search(const gchar *query, GPtrArray *results)
+{
+    g_ptr_array_set_size ( results, 0 );
+
+    gchar *lowerQuery = g_utf8_strdown ( query, -1 );
+    guint length = strlen ( lowerQuery );
+
+    if ( length == 0 )
+    {
+        g_free ( lowerQuery );
+        g_free ( _lastQuery );
+        _lastQuery = NULL;
+        g_array_set_size ( _lastMatches, 0 );
+        return;
+    }
+
+    GArray *candidates = g_array_new ( FALSE, FALSE, sizeof ( guint ) );
+
+    // Longer query matches a subset of what shorter one did, unless it
+    // has just switched from word beginnings to substrings
+    guint lastLength = _lastQuery != NULL ? strlen ( _lastQuery ) : 0;
+    if ( _lastQuery != NULL && g_str_has_prefix ( lowerQuery, _lastQuery ) &&
+         ( lastLength >= TRIGRAM_LENGTH || length < TRIGRAM_LENGTH ) )
+        g_array_append_vals ( candidates, _lastMatches->data, _lastMatches->len );
+    else
+        _candidates ( lowerQuery, length, candidates );
+
+    g_array_set_size ( _lastMatches, 0 );
+    for ( guint i = 0; i < candidates->len; i++ )
+    {
+        guint entry = g_array_index ( candidates, guint, i );
+        if ( _matches ( entry, lowerQuery, length ) )
+            g_array_append_val ( _lastMatches, entry );
+    }
+
+    g_array_free ( candidates, TRUE );
+
+    g_free ( _lastQuery );
+    _lastQuery = lowerQuery;
+
+    for ( int rank = 0; rank < 3; rank++ )
+    {
+        for ( guint i = 0; i < _lastMatches->len; i++ )
+        {
+            guint entry = g_array_index ( _lastMatches, guint, i );
+            if ( _rank ( entry, lowerQuery, length ) == rank )
+                g_ptr_array_add ( results, _entry(entry)->app );
+        }
+    }
+}
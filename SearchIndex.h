@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2010 Andry Gunawan <angun33@gmail.com>
+ *
+ *  Parts of this file are based on Telescope which is
+ *  Copyright (c) 2010 Ilya Skriblovsky <Ilya.Skriblovsky@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <glib.h>
+
+class Application;
+
+// Index of application names and executables for type-to-search.
+//
+// Queries of one or two characters match beginnings of words, they are
+// looked up in the sorted word list. Longer queries match anywhere and
+// are looked up by the rarest of their trigrams. A query which extends
+// the previous one only filters previous results.
+class SearchIndex
+{
+public:
+    SearchIndex();
+    ~SearchIndex();
+
+    // Index is filled with add() between clear() and finish()
+    void clear();
+    void add(Application *app);
+    void finish();
+
+    // Fills results with matching applications, best matches first:
+    // name starting with the query, then a word of the name, then the
+    // rest, alphabetically within each group
+    void search(const gchar *query, GPtrArray *results);
+
+private:
+    struct Entry
+    {
+        Application *app;
+        gchar *text;        // lower case name, '\n', executable name
+        guint nameLength;
+    };
+
+    struct Word
+    {
+        const gchar *start;     // points into Entry::text
+        guint entry;
+    };
+
+    GPtrArray *_entries;        // Entry*, sorted by name after finish()
+    GArray *_words;             // Word, sorted by text
+    GHashTable *_trigrams;      // packed trigram -> GArray of entry numbers
+
+    // Previous query and its matches, in entry order
+    gchar *_lastQuery;
+    GArray *_lastMatches;
+
+    Entry * _entry(guint index) { return (Entry*) g_ptr_array_index ( _entries, index ); }
+
+    static bool _isWordStart(const gchar *text, const gchar *c);
+    bool _matches(guint entry, const gchar *query, guint length);
+    void _candidates(const gchar *query, guint length, GArray *candidates);
+    int _rank(guint entry, const gchar *query, guint length);
+
+    static gint _compareEntries(gconstpointer a, gconstpointer b);
+    static gint _compareWords(gconstpointer a, gconstpointer b);
+    static void _freePostings(gpointer postings);
+};
+
+#endif // SEARCHINDEX_H
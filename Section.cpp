@@ -30,24 +30,25 @@
 XftFont *Section::_xftFont = 0;
 
 Section::Section(Display *dpy, const gchar *name)
-    :_dpy(dpy), _icon(0), _iconOwned(false), _iconChangedCallback(0)
+    :_dpy(dpy), _icon(0), _iconOwned(false), _iconChangedCallback(0), _page(0)
 {
     setName(name);
     _partNo = 1;
     _applications = g_ptr_array_new();
+    _pageApplications = g_ptr_array_new();
 }
 
 Section::~Section()
 {
     g_log(G_LOG_DOMAIN, G_LOG_LEVEL_INFO, "Section dtor");
 
-    for (guint i = 0; i < _applications->len; i++)
-    {
-        delete getApplication(i);
-    }
+    // Applications are owned by MenuReader, they survive menu reloads
     g_ptr_array_free(_applications, TRUE);
     g_free(_name);
 
+    delete _page;
+    g_ptr_array_free(_pageApplications, TRUE);
+
     if ( _xftFont != 0 )
     {
         XftFontClose( _dpy, _xftFont );
@@ -122,19 +123,35 @@ void Section::addApplication(Application *app)
     g_ptr_array_add(_applications, (gpointer) app);
 }
 
+void Section::clearApplications()
+{
+    g_ptr_array_set_size(_applications, 0);
+}
+
 guint Section::getApplicationsSize()
 {
     return _applications->len;
 }
 
-void Section::draw(Display *dpy, Image* image, int x, int y, int width, int height )
+bool Section::hasSameContents(Section *other)
 {
-    // position the applications and draw them
-    uint col, row;
-    col = row = 0;
-    Application * app;
+    if ( strcmp ( _name, other->_name ) != 0 || _partNo != other->_partNo )
+        return false;
+
+    if ( _applications->len != other->_applications->len )
+        return false;
 
+    for (guint i = 0; i < _applications->len; i++)
+    {
+        if ( getApplication(i) != other->getApplication(i) )
+            return false;
+    }
+
+    return true;
+}
 
+void Section::cellPosition(guint index, int width, int height, int *x, int *y)
+{
     bool landscape = width >= height;
 
     uint cols = landscape ? NUM_COLS : NUM_ROWS; // (width - 2 * xborder + xmingap) / (Application::width() + xmingap);
@@ -145,38 +162,117 @@ void Section::draw(Display *dpy, Image* image, int x, int y, int width, int heig
     //int ygap = 36;
     int ygap = (height / rows - Application::height()) / 2;
 
+    uint col = index % cols;
+    uint row = index / cols;
+
+    *x = col * width / cols + xgap;
+    *y = row * height / rows + ygap;
+}
+
+Image* Section::page(int x, int y, int width, int height)
+{
+    if ( _page != NULL && ( _page->width() != width || _page->height() != height ) )
+        releasePage();
+
+    if ( _page == NULL )
+    {
+        _page = new Image ( _dpy, width, height );
+        _page->clear();
+    }
+
+    int cellX, cellY;
+
+    // position the applications and redraw changed tiles on the page
     for ( uint i = 0; i < _applications->len; i++ )
     {
-        if ( col >= cols )
-        {
-            col = 0;
-            row++;
-        }
-
-//        if ( row >= NUM_ROWS )
-//            break;
-
-        // draw the app icon
-        app = getApplication ( i );
-        app->setPosition(
-            x + col * width / cols + xgap,
-            y + row * height / rows + ygap
-        );
-
-        // blit the icon into the section pixmap
-        XRenderComposite ( _dpy, PictOpOver,
-                           app->image()->picture(), None, image->picture(),
+        Application *app = getApplication ( i );
+
+        cellPosition ( i, width, height, &cellX, &cellY );
+        app->setPosition ( x + cellX, y + cellY );
+
+        if ( i < _pageApplications->len && g_ptr_array_index ( _pageApplications, i ) == app )
+            continue;
+
+        XRenderComposite ( _dpy, PictOpSrc,
+                           app->image()->picture(), None, _page->picture(),
                            0, 0,
                            0, 0,
-                           app->x(), app->y(),
+                           cellX, cellY,
                            app->width(), app->height());
 
-        col++;
+        if ( i < _pageApplications->len )
+            g_ptr_array_index ( _pageApplications, i ) = app;
+        else
+            g_ptr_array_add ( _pageApplications, app );
+    }
+
+    // Clearing cells of removed applications
+    XRenderColor transparent = { 0, 0, 0, 0 };
+    for ( uint i = _applications->len; i < _pageApplications->len; i++ )
+    {
+        cellPosition ( i, width, height, &cellX, &cellY );
+        XRenderFillRectangle ( _dpy, PictOpClear, _page->picture(), &transparent,
+                               cellX, cellY, Application::width(), Application::height() );
+    }
+    if ( _pageApplications->len > _applications->len )
+        g_ptr_array_set_size ( _pageApplications, _applications->len );
+
+    return _page;
+}
+
+void Section::draw(Display *dpy, Image* image, int x, int y, int width, int height )
+{
+    // blit the page into the window buffer
+    XRenderComposite ( _dpy, PictOpOver,
+                       page ( x, y, width, height )->picture(), None, image->picture(),
+                       0, 0,
+                       0, 0,
+                       x, y,
+                       width, height );
+}
+
+void Section::invalidateApplication(Application *app)
+{
+    for ( guint i = 0; i < _pageApplications->len; i++ )
+    {
+        if ( g_ptr_array_index ( _pageApplications, i ) == app )
+            g_ptr_array_index ( _pageApplications, i ) = NULL;
     }
 }
 
+void Section::takePage(Section *old)
+{
+    if ( _page != NULL || old->_page == NULL )
+        return;
+
+    _page = old->_page;
+    old->_page = 0;
+
+    GPtrArray *pageApplications = _pageApplications;
+    _pageApplications = old->_pageApplications;
+    old->_pageApplications = pageApplications;
+}
+
+void Section::releasePage()
+{
+    delete _page;
+    _page = 0;
+    g_ptr_array_set_size ( _pageApplications, 0 );
+}
 
 
+void Section::prefetchIcons()
+{
+    for ( guint i = 0; i < _applications->len; i++ )
+        getApplication ( i )->prefetchIcon();
+}
+
+void Section::cancelPrefetch()
+{
+    for ( guint i = 0; i < _applications->len; i++ )
+        getApplication ( i )->cancelPrefetch();
+}
+
 
 void Section::setIconChangedCallback(IconChangedCallback callback, void *data)
 {
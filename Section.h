@@ -40,9 +40,30 @@ public:
     gchar * getNameWithPart();
     Application * getApplication(guint index);
     void addApplication(Application *app);
+    void clearApplications();
     guint getApplicationsSize();
+    bool hasSameContents(Section *other);
+    // Tiles are composed into section page, which is redrawn only where
+    // applications have changed, and then the page is drawn at once
     void draw(Display *dpy, Image* image, int x, int y, int width, int height);
 
+    // Brings page up to date and positions applications for the page
+    // shown at x, y. Page is owned by the section.
+    Image* page(int x, int y, int width, int height);
+
+    // Tile of the application will be redrawn on the page
+    void invalidateApplication(Application *app);
+
+    // Takes page of the replaced section with the same name and part
+    void takePage(Section *old);
+    void releasePage();
+
+    // Starts decoding icons of applications which are not drawn yet
+    void prefetchIcons();
+
+    // Frees icons prefetched for the section which is not a neighbour anymore
+    void cancelPrefetch();
+
     Image* getIcon() { return _icon; }
     bool isIconOwned() { return _iconOwned; }
     void setIcon(Image *icon, bool own);
@@ -63,6 +84,13 @@ private:
 
     IconChangedCallback _iconChangedCallback;
     void *_iconChangedCallbackData;
+
+    // Applications in order they are drawn on page, NULL for cells
+    // which must be redrawn
+    Image* _page;
+    GPtrArray* _pageApplications;
+
+    void cellPosition(guint index, int width, int height, int *x, int *y);
 };
 
 #endif // SECTION_H
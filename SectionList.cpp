@@ -49,6 +49,11 @@ void SectionList::add(Section *section)
     g_ptr_array_add(_sections, (gpointer) section);
 }
 
+void SectionList::set(guint index, Section *section)
+{
+    g_ptr_array_index(_sections, index) = (gpointer) section;
+}
+
 bool SectionList::has(Section *section)
 {
     for ( uint i = 0; i < _sections->len; i++ )
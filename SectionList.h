@@ -31,6 +31,7 @@ public:
     guint getSize();
     Section * get(guint index);
     void add(Section *section);
+    void set(guint index, Section *section);
     bool has(Section *section);
 
 private:
@@ -28,6 +28,7 @@ Settings::Settings()
 
     // Default values
     _scrollingEnabled = false;
+    _scrollingMinWidth = 160;
 
     _backgroundFilename = 0; // Will be set later if not in config file
     _backgroundMode = Stretched;
@@ -66,11 +67,19 @@ Settings::Settings()
 
     _showDesktopByIconify = false;
 
+    _repaintRate = 60;
+    _repaintWindowRate = 30;
+
+    _backgroundRefresh = false;
+    _backgroundRefreshRate = 2;
+    _backgroundRefreshBudget = 4;
+
     _hotKey = strdup("F5");
 
 
     #ifdef LAUNCHER
         _disableLauncher = false;
+        _launcherTilesCacheSize = 4096;
     #endif
 
     _categoryIconsDir = strdup("/usr/share/telescope/category-icons/");
@@ -277,6 +286,11 @@ void Settings::parseOpt(const char *key, const char *value)
         else
             printf("Scrolling disabled\n");
     }
+    else if (strcmp(key, "scrolling.minwidth") == 0)
+    {
+        _scrollingMinWidth = atoi(value);
+        if (_scrollingMinWidth < 0) _scrollingMinWidth = 0;
+    }
     else if (strcmp(key, "background.filename") == 0)
     {
         free(_backgroundFilename);
@@ -375,6 +389,11 @@ void Settings::parseOpt(const char *key, const char *value)
         }
         else if (strcmp(key, "launcher.disable") == 0)
             _disableLauncher = parseBool(value);
+        else if (strcmp(key, "launcher.tiles.cachesize") == 0)
+        {
+            _launcherTilesCacheSize = atoi(value);
+            if (_launcherTilesCacheSize < 0) _launcherTilesCacheSize = 0;
+        }
         else if (strcmp(key, "launcher.categories.iconsdir") == 0)
         {
             free(_categoryIconsDir);
@@ -401,6 +420,28 @@ void Settings::parseOpt(const char *key, const char *value)
         _showDesktopThumbnail = parseBool(value);
     else if (strcmp(key, "show.desktop.iconify") == 0)
         _showDesktopByIconify = parseBool(value);
+    else if (strcmp(key, "repaint.rate") == 0)
+    {
+        _repaintRate = atoi(value);
+        if (_repaintRate < 1) _repaintRate = 1;
+    }
+    else if (strcmp(key, "repaint.window.rate") == 0)
+    {
+        _repaintWindowRate = atoi(value);
+        if (_repaintWindowRate < 1) _repaintWindowRate = 1;
+    }
+    else if (strcmp(key, "background.refresh") == 0)
+        _backgroundRefresh = parseBool(value);
+    else if (strcmp(key, "background.refresh.rate") == 0)
+    {
+        _backgroundRefreshRate = atoi(value);
+        if (_backgroundRefreshRate < 1) _backgroundRefreshRate = 1;
+    }
+    else if (strcmp(key, "background.refresh.budget") == 0)
+    {
+        _backgroundRefreshBudget = atoi(value);
+        if (_backgroundRefreshBudget < 1) _backgroundRefreshBudget = 1;
+    }
     else if (strcmp(key, "hotkey") == 0)
     {
         free(_hotKey);
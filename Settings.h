@@ -27,6 +27,7 @@ class Settings
         static Settings *_instance;
 
         bool _scrollingEnabled;
+        int _scrollingMinWidth;
         char *_backgroundFilename;
         BackgroundMode _backgroundMode;
         char *_backgroundColor;
@@ -67,9 +68,17 @@ class Settings
 
         bool _showDesktopByIconify;
 
+        int _repaintRate;
+        int _repaintWindowRate;
+
+        bool _backgroundRefresh;
+        int _backgroundRefreshRate;
+        int _backgroundRefreshBudget;
+
 
         #ifdef LAUNCHER
             bool _disableLauncher;
+            int _launcherTilesCacheSize;
         #endif
 
 
@@ -91,6 +100,9 @@ class Settings
         static Settings* instance();
 
         bool scrollingEnabled() { return _scrollingEnabled; }
+        // Thumbnails are never made narrower than this when scrolling is
+        // enabled, the rest of them is below the screen
+        int scrollingMinWidth() { return _scrollingMinWidth; }
 
         const char* backgroundFilename() { return _backgroundFilename; }
         BackgroundMode backgroundMode() { return _backgroundMode; }
@@ -129,6 +141,13 @@ class Settings
 
         bool showDesktopByIconify() { return _showDesktopByIconify; }
 
+        int repaintRate() { return _repaintRate; }
+        int repaintWindowRate() { return _repaintWindowRate; }
+
+        bool backgroundRefresh() { return _backgroundRefresh; }
+        int backgroundRefreshRate() { return _backgroundRefreshRate; }
+        int backgroundRefreshBudget() { return _backgroundRefreshBudget; }
+
 
         const char *hotKey() { return _hotKey; }
 
@@ -143,6 +162,12 @@ class Settings
         }
 
 
+        #ifdef LAUNCHER
+            // In kilobytes
+            int launcherTilesCacheSize() { return _launcherTilesCacheSize; }
+        #endif
+
+
         const char *categoryIconsDir() { return _categoryIconsDir; }
 };
 
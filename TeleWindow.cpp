@@ -16,6 +16,7 @@
 #include <sys/time.h>
 
 #include <X11/Xatom.h>
+#include <X11/extensions/Xfixes.h>
 
 #include "XTools.h"
 #include "Thumbnail.h"
@@ -25,12 +26,19 @@
 #include "Image.h"
 
 #include "XEventLoop.h"
+#include "Trace.h"
 
 #ifdef LAUNCHER
     #include "LauncherWindow.h"
 #endif
 
 
+// Pixels per second. Slower drag just stops when released
+#define KINETIC_MIN_VELOCITY 100
+// Pixels per second squared
+#define KINETIC_DECELERATION 2000
+
+
 TeleWindow::TeleWindow(Display *dpy)
     :_dpy(dpy), _mappings(dpy)
 {
@@ -57,8 +65,12 @@ TeleWindow::TeleWindow(Display *dpy)
     _scrollBaseY = 0;
     _scrollX = 0;
     _scrollY = 0;
+    _contentHeight = 0;
     _buttonPressed = false;
 
+    _kineticTimeout = 0;
+    _velocityY = 0;
+
 
 
 
@@ -104,9 +116,18 @@ TeleWindow::TeleWindow(Display *dpy)
 
 
     // Double buffering pixmap
+    _scene = new Scene(_dpy, _win, _gc);
     _buffer = 0;
     recreateBuffer();
 
+    _wallpaperNode.setGeometry(0, 0, _width, _height);
+    _scene->add(&_wallpaperNode);
+
+    _contentNode = new ScrollNode(_dpy);
+    _contentNode->setGeometry(0, 0, _width, _height);
+    _scene->add(_contentNode);
+    _surfaceTop = 0;
+
 
 
     _shown = false;
@@ -126,6 +147,13 @@ TeleWindow::TeleWindow(Display *dpy)
 
     _activeThumbnail = 0;
 
+    _windowTypesChanged = false;
+
+
+    // Repaint scheduler
+    _frameTimeout = 0;
+    _lastFrameTime = 0;
+
 
     markThumbnailsListDirty();
 
@@ -138,10 +166,15 @@ TeleWindow::~TeleWindow()
 {
      XUngrabKey(_dpy, _hotKeyCode, AnyModifier, _rootWindow);
 
+    if (_frameTimeout)
+        XEventLoop::instance()->cancelTimeout(_frameTimeout);
+    stopKinetic();
 
-    for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+    for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
         delete *i;
 
+    delete _contentNode;
+    delete _scene;
 
     delete _buffer;
 
@@ -166,6 +199,8 @@ Window TeleWindow::window()
 
 bool TeleWindow::show()
 {
+    TraceScope trace("show");
+
     updateThumbnailsList();
 
     if (_thumbnails.size() == 0)
@@ -173,6 +208,10 @@ bool TeleWindow::show()
 
     _shown = true;
 
+    // Background refresh may have left timeout at low rate. Everything
+    // queued is drawn by updatePreviews() below
+    cancelFrame();
+
     Thumbnail *prevActiveThumbnail = _activeThumbnail;
 
     Window activeWindow = XTools::activeWindow();
@@ -180,7 +219,7 @@ bool TeleWindow::show()
     if (activeWindow != 0)
     {
         _activeThumbnail = 0;
-        for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+        for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
             if ((*i)->clientWindow() == activeWindow)
                 _activeThumbnail = *i;
     }
@@ -193,6 +232,13 @@ bool TeleWindow::show()
         if (prevActiveThumbnail) prevActiveThumbnail->redraw();
     }
 
+    if (_activeThumbnail)
+        ensureVisible(_activeThumbnail);
+
+    // Previews went stale while hidden. Window is painted on Expose
+    updatePreviews();
+    _scene->invalidateAll();
+
 
     XMapWindow(_dpy, _win);
     XTools::switchToWindow(_win);
@@ -206,7 +252,7 @@ bool TeleWindow::show()
         if (_activeThumbnail->mustBeIconifiedBeforeTelescope())
         {
             paint();
-            XSync(_dpy, 0);
+            XEventLoop::instance()->sync();
             struct timeval timeout;
             timeout.tv_sec = 0;
             timeout.tv_usec = 100000;
@@ -235,9 +281,22 @@ bool TeleWindow::show()
 
 void TeleWindow::hide()
 {
-    XUnmapWindow(_dpy, _win);
-
+    // Frame scheduled below uses background refresh rate
     _shown = false;
+
+    if (Settings::instance()->backgroundRefresh())
+    {
+        // Queued thumbnails are refreshed in background
+        cancelFrame();
+        if (_dirtyThumbnails.size() > 0)
+            scheduleFrame();
+    }
+    else
+        discardScheduledRepaints();
+
+    stopKinetic();
+
+    XUnmapWindow(_dpy, _win);
 }
 
 bool TeleWindow::shown()
@@ -258,6 +317,15 @@ void TeleWindow::markThumbnailsListDirty()
         if (_thumbnails.size() == 0)
             hide();
     }
+    else if (Settings::instance()->backgroundRefresh())
+    {
+        // New thumbnails should be ready before the hotkey
+        updateThumbnailsList();
+
+        for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+            if (! (*i)->previewValid())
+                scheduleThumbRepaint(*i);
+    }
 }
 
 
@@ -267,43 +335,127 @@ void TeleWindow::updateThumbnailsList()
     if (_thumbnailsListDirty == false)
         return;
 
+    TraceScope trace("updateThumbnailsList");
+
 
 
     bool wasChanged = false;
 
 
-    LinkedList<Window> windows = XTools::windowList(_rootWindow,
-        Settings::instance()->showDesktopThumbnail());
-    for (LinkedList<Window>::Iter i = windows.head(); i; ++i)
+    Vector<Window> clients = XTools::clientList(_rootWindow);
+
+    // _NET_CLIENT_LIST is replaced on many occasions without actual changes
+    if (clients == _clientList && ! _windowTypesChanged)
+    {
+        _thumbnailsListDirty = false;
+        return;
+    }
+
+    bool includeDesktop = Settings::instance()->showDesktopThumbnail();
+
+    // Sets of all current client windows and of ones having thumbnails
+    HashMap<Window, bool> allClientWindows;
+    HashMap<Window, bool> clientWindows;
+
+    // Windows without cached type. Everything about them is fetched in
+    // one batch
+    Vector<Window> newWindows;
+    for (Vector<Window>::Iter i = clients.head(); i; ++i)
+        if (*i != _win)
+        {
+            allClientWindows.insert(*i, true);
+
+            if (! _windowTypes.contains(*i))
+            {
+                // Listening for PropertyNotify to know when cached type
+                // becomes stale
+                XSelectInput(_dpy, *i, StructureNotifyMask | PropertyChangeMask);
+                newWindows.append(*i);
+            }
+        }
+
+    int newCount = newWindows.size();
+    WindowInfo *newInfos = new WindowInfo[newCount];
+    HashMap<Window, int> newInfoIndex;
+    for (int n = 0; n < newCount; ++n)
+    {
+        newInfos[n].window = newWindows[n];
+        newInfoIndex.insert(newWindows[n], n);
+    }
+
+    XTools::fetchWindowInfo(newInfos, newCount);
+
+
+    for (Vector<Window>::Iter i = clients.head(); i; ++i)
         if (*i != _win)
         {
-            bool found = false;
-            for (LinkedList<Thumbnail*>::Iter j = _thumbnails.head(); j; ++j)
-                if ((*j)->clientWindow() == *i)
+            WindowInfo *info = 0;
+
+            Atom *type = _windowTypes.find(*i);
+            if (! type)
+            {
+                info = &newInfos[newInfoIndex.value(*i)];
+                if (! info->valid)
+                    continue;   // Already destroyed
+
+                _windowTypes.insert(*i, info->type);
+                type = _windowTypes.find(*i);
+            }
+
+            if (! XTools::isSwitchableWindowType(*type, includeDesktop))
+                continue;
+
+            clientWindows.insert(*i, true);
+
+            if (! _thumbnailsByWindow.contains(*i))
+            {
+                if (! info)
                 {
-                    found = true;
-                    break;
+                    // Type is cached, but thumbnail is missing. Should not
+                    // normally happen
+                    WindowInfo single;
+                    single.window = *i;
+                    XTools::fetchWindowInfo(&single, 1);
+                    if (single.valid)
+                        addThumbnail(&single);
+                    free(single.title);
+                    free(single.clientClass);
                 }
+                else
+                    addThumbnail(info);
 
-            if (! found)
-            {
-                Thumbnail *th = new Thumbnail(this, *i);
-                _thumbnails.append(th);
                 wasChanged = true;
             }
         }
 
-    LinkedList<Thumbnail*> thumbsToDelete;
-    for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
-        if (! windows.contains((*i)->clientWindow()))
-            thumbsToDelete.append(*i);
-
-    for (LinkedList<Thumbnail*>::Iter i = thumbsToDelete.head(); i; ++i)
+    for (int n = 0; n < newCount; ++n)
     {
-        removeThumbnail(*i);
-        delete *i;
-        wasChanged = true;
+        free(newInfos[n].title);
+        free(newInfos[n].clientClass);
     }
+    delete[] newInfos;
+
+    // Windows that left client list without being destroyed
+    for (Vector<Window>::Iter i = _clientList.head(); i; ++i)
+        if (! allClientWindows.contains(*i) && _windowTypes.contains(*i))
+        {
+            XSelectInput(_dpy, *i, 0);
+            _windowTypes.remove(*i);
+        }
+
+    _clientList = clients;
+    _windowTypesChanged = false;
+
+    for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+        if (! clientWindows.contains((*i)->clientWindow()))
+        {
+            // Removing by iterator, removeThumbnail() would search the list
+            Thumbnail *th = *i;
+            _thumbnails.remove(i);
+            forgetThumbnail(th);
+            delete th;
+            wasChanged = true;
+        }
 
 
     if (wasChanged)
@@ -321,6 +473,8 @@ inline int min(int a, int b)
 
 void TeleWindow::layoutThumbnails()
 {
+    TraceScope trace("layoutThumbnails");
+
     int n = _thumbnails.size();
 
     if (n == 0)
@@ -355,30 +509,64 @@ void TeleWindow::layoutThumbnails()
     int columns = maxColumns;
     int rows = (n + columns - 1) / columns;
 
-    int tileWidth = _width / columns;
-    int tileHeight = _height / rows;
-    int border = (int)(_width / columns * 0.1f);
-
+    int tileWidth, tileHeight;
+    int border;
     int thumbWidth, thumbHeight;
 
-    if (n > 1)
+    int minWidth = Settings::instance()->scrollingEnabled() ?
+        Settings::instance()->scrollingMinWidth() : 0;
+
+    if (n > 1 && maxSize < minWidth)
     {
-        thumbWidth = _width / columns - border;
-        thumbHeight = _height / rows - border;
+        // Thumbnails would be too small to recognize. Keeping them at
+        // minimal size in as many rows as needed, window scrolls
+        // vertically to the rest of them
+        columns = (int)(_width / (minWidth / 0.9f));
+        if (columns < 1)
+            columns = 1;
+        rows = (n + columns - 1) / columns;
+
+        tileWidth = _width / columns;
+        border = (int)(tileWidth * 0.1f);
+        thumbWidth = tileWidth - border;
+        thumbHeight = thumbWidth * _height / _width;
+        tileHeight = thumbHeight + border;
     }
     else
     {
-        thumbWidth = _width * 2 / 3;
-        thumbHeight = _height * 2 / 3;
+        tileWidth = _width / columns;
+        tileHeight = _height / rows;
+        border = (int)(_width / columns * 0.1f);
+
+        if (n > 1)
+        {
+            thumbWidth = _width / columns - border;
+            thumbHeight = _height / rows - border;
+        }
+        else
+        {
+            thumbWidth = _width * 2 / 3;
+            thumbHeight = _height * 2 / 3;
+        }
     }
 
+    _contentHeight = rows * tileHeight;
+    clampScroll(&_scrollX, &_scrollY);
+
+    // Visible part of the content and up to half a screen above and below
+    int surfaceHeight = min(_contentHeight, _height * 2);
+    if (surfaceHeight < _height)
+        surfaceHeight = _height;
+    _contentNode->setSurfaceSize(_width, surfaceHeight);
+    placeSurface();
+
     int tileXOffset = (tileWidth - thumbWidth) / 2;
     int tileYOffset = (tileHeight-thumbHeight) / 2;
 
     int lastRowX = 0;
 
     int index = 0;
-    LinkedList<Thumbnail*>::Iter thumb = _thumbnails.head();
+    Vector<Thumbnail*>::Iter thumb = _thumbnails.head();
     for (int row = 0; row < rows; ++row)
     {
         if (row == rows - 1)
@@ -386,7 +574,7 @@ void TeleWindow::layoutThumbnails()
             lastRowX = (_width - (n - index) * tileWidth) / 2;
         }
 
-        int tileY = row * tileHeight;
+        int tileY = row * tileHeight - _surfaceTop;
 
         for (int column = 0; column < columns; ++column, ++thumb, ++index)
         {
@@ -402,14 +590,130 @@ void TeleWindow::layoutThumbnails()
         }
     }
 
+    _contentNode->setOffset(_scrollX, _surfaceTop + _scrollY);
+    updateViewport();
+
     if (_shown)
         paint();
 }
 
 
+void TeleWindow::clampScroll(int *x, int *y)
+{
+    // Thumbnails always fit horizontally
+    *x = 0;
+
+    int minY = min(_height - _contentHeight, 0);
+    if (*y < minY) *y = minY;
+    if (*y > 0) *y = 0;
+}
+
+
+void TeleWindow::placeSurface()
+{
+    // Centered on the viewport as far as content allows
+    int surfaceHeight = _contentNode->surfaceHeight();
+    int top = -_scrollY - (surfaceHeight - _height) / 2;
+
+    if (top > _contentHeight - surfaceHeight)
+        top = _contentHeight - surfaceHeight;
+    if (top < 0)
+        top = 0;
+
+    _surfaceTop = top;
+}
+
+
+void TeleWindow::scrollTo(int x, int y)
+{
+    clampScroll(&x, &y);
+
+    if (x == _scrollX && y == _scrollY)
+        return;
+
+    _scrollX = x;
+    _scrollY = y;
+
+    if (-_scrollY < _surfaceTop ||
+        -_scrollY + _height > _surfaceTop + _contentNode->surfaceHeight())
+    {
+        // Viewport has left the surface. Thumbnails are moved in surface
+        // coordinates and their new places are composed anew
+        int oldTop = _surfaceTop;
+        placeSurface();
+
+        for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+            (*i)->move(0, oldTop - _surfaceTop);
+    }
+
+    // Rendered on idle, once for all motion events received together
+    _contentNode->setOffset(_scrollX, _surfaceTop + _scrollY);
+
+    updateViewport();
+}
+
+
+void TeleWindow::ensureVisible(Thumbnail *thumb)
+{
+    int y = thumb->y() + _contentNode->offsetY();
+
+    if (y < 0)
+        scrollTo(_scrollX, _scrollY - y);
+    else if (y + thumb->height() > _height)
+        scrollTo(_scrollX, _scrollY - (y + thumb->height() - _height));
+}
+
+
+void TeleWindow::updateViewport()
+{
+    // Previews within half a screen from the viewport are kept current,
+    // so they are ready when scrolled in
+    int margin = _height / 2;
+
+    for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+    {
+        Thumbnail *thumb = *i;
+        int y = thumb->y() + _contentNode->offsetY();
+
+        bool near = y + thumb->height() > -margin && y < _height + margin;
+
+        if (near != thumb->paused())
+            continue;
+
+        thumb->setPaused(! near);
+
+        // Damage received while paused has only invalidated the preview
+        if (near && _shown)
+        {
+            thumb->drawPreview();
+            thumb->clearDamage();
+            thumb->node()->invalidate();
+        }
+    }
+}
+
+
+void TeleWindow::addThumbnail(WindowInfo *info)
+{
+    Thumbnail *th = new Thumbnail(this, info);
+    _thumbnails.append(th);
+    _contentNode->content()->add(th->node());
+    _thumbnailsByWindow.insert(info->window, th);
+}
+
 void TeleWindow::removeThumbnail(Thumbnail *thumb)
 {
     _thumbnails.removeByValue(thumb);
+    forgetThumbnail(thumb);
+}
+
+void TeleWindow::forgetThumbnail(Thumbnail *thumb)
+{
+    if (thumb->repaintPending())
+        _dirtyThumbnails.removeByValue(thumb);
+
+    _thumbnailsByWindow.remove(thumb->clientWindow());
+
     if (_activeThumbnail == thumb)
         _activeThumbnail = 0;
 }
@@ -430,28 +734,37 @@ void TeleWindow::onEvent(XEvent *event)
     }
     else
     {
-        bool found = false;
-        for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+        Window window = event->xany.window;
+
+        if (event->type == PropertyNotify &&
+            event->xproperty.atom == XTools::_NET_WM_WINDOW_TYPE)
         {
-            if ((*i)->clientWindow() == event->xany.window)
+            if (_windowTypes.contains(window))
             {
-                if (event->type == DestroyNotify)
-                {
-                    (*i)->setClientDestroyed(true);
-                    removeThumbnail(*i);
-                    delete *i;
-                    // markThumbnailsListDirty();
-                    layoutThumbnails();
-                }
-                else
-                    (*i)->onClientEvent(event);
+                _windowTypes.remove(window);
+                _windowTypesChanged = true;
+                markThumbnailsListDirty();
+            }
+            return;
+        }
 
-                found = true;
-                break;
+        if (event->type == DestroyNotify)
+            _windowTypes.remove(window);
+
+        Thumbnail *thumb = _thumbnailsByWindow.value(window, 0);
+        if (thumb)
+        {
+            if (event->type == DestroyNotify)
+            {
+                thumb->setClientDestroyed(true);
+                removeThumbnail(thumb);
+                delete thumb;
+                // markThumbnailsListDirty();
+                layoutThumbnails();
             }
+            else
+                thumb->onClientEvent(event);
         }
-        if (found)
-            return;
     }
 }
 
@@ -462,7 +775,10 @@ void TeleWindow::onRootEvent(XEvent *event)
     if (event->type == KeyPress)
     {
         if (event->xkey.keycode == _hotKeyCode)
+        {
+            Trace::instant("hotkey");
             onHotKeyPress();
+        }
         else
             _mappings.handleEvent(this, Mapping::GlobalPress, event->xkey.keycode);
     }
@@ -490,8 +806,8 @@ void TeleWindow::onRootEvent(XEvent *event)
 
         if (event->xproperty.atom == XTools::_NET_CLIENT_LIST)
         {
-            // FIXME: This notify seems to be sent too often,
-            // even when no windows actually changed
+            // This notify is sent too often, even when no windows actually
+            // changed. updateThumbnailsList() checks it cheaply
             markThumbnailsListDirty();
         }
     }
@@ -516,9 +832,9 @@ void TeleWindow::onTeleWindowEvent(XEvent *event)
         onButtonRelease(&event->xbutton);
     else if (event->type == MotionNotify)
         onButtonMotion(&event->xmotion);
-    else if (event->type == Expose && event->xexpose.count < 1)
-        //paint();
-        _repaintOnIdle = true;
+    else if (event->type == Expose)
+        _scene->invalidate(event->xexpose.x, event->xexpose.y,
+            event->xexpose.width, event->xexpose.height);
     else if (event->type == ConfigureNotify)
     {
         bool relayout = _width != event->xconfigure.width || _height != event->xconfigure.height;
@@ -534,51 +850,252 @@ void TeleWindow::onTeleWindowEvent(XEvent *event)
 }
 
 
+void TeleWindow::updatePreviews()
+{
+    for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+    {
+        if (! (*i)->paused())
+            (*i)->drawPreview();
+        (*i)->clearDamage();
+    }
+
+    _contentNode->content()->invalidateAll();
+
+    // Everything is up to date now
+    for (Vector<Thumbnail*>::Iter i = _dirtyThumbnails.head(); i; ++i)
+        (*i)->setRepaintPending(false);
+    _dirtyThumbnails.clear();
+}
+
+
 void TeleWindow::paint()
 {
     if (! _shown)
         return;
 
+    TraceScope trace("paint");
 
-    XCopyArea(_dpy, Resources::instance()->wallpaper()->pixmap(), _buffer->pixmap(), _gc,
-        0, 0, _width, _height, 0, 0
-    );
+    updatePreviews();
 
+    _scene->invalidateAll();
+    renderScene();
+}
 
-    for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+
+void TeleWindow::renderScene()
+{
+    Trace::instant("renderScene");
+
+    _scene->render();
+
+    if (Trace::enabled())
     {
-        (*i)->drawPreview();
-        blitThumb(*i);
+        // Waiting for server to actually execute everything, so the trace
+        // shows when pixels are on screen, not when we queued them
+        XEventLoop::instance()->sync();
+        Trace::instant("synced");
     }
+}
 
 
-    blitBuffer();
+void TeleWindow::selectionChanged(Thumbnail *prevActiveThumbnail)
+{
+    if (prevActiveThumbnail == _activeThumbnail)
+        return;
+
+    TraceScope trace("selectionChanged");
+
+    // Only headers and borders of these two depend on selection
+    if (_activeThumbnail)
+        _activeThumbnail->redraw();
+    if (prevActiveThumbnail)
+        prevActiveThumbnail->redraw();
+
+    if (_activeThumbnail)
+        _activeThumbnail->node()->invalidate();
+    if (prevActiveThumbnail)
+        prevActiveThumbnail->node()->invalidate();
+
+    // Keyboard selection may go below the screen
+    if (_activeThumbnail)
+        ensureVisible(_activeThumbnail);
+
+    if (_shown)
+        renderScene();
 }
 
-void TeleWindow::blitThumb(Thumbnail *thumb)
+
+void TeleWindow::onThumbRedrawed(Thumbnail *thumb)
 {
-    XRenderComposite(_dpy, PictOpOver,
-        thumb->image()->picture(), None, _buffer->picture(),
-        0, 0,
-        0, 0,
-        thumb->x(), thumb->y(),
-        thumb->width(), thumb->height()
-    );
+    // Header has changed, not only the damaged part of preview
+    thumb->node()->invalidate();
+    renderScene();
 }
 
 
-void TeleWindow::blitBuffer()
+
+void TeleWindow::scheduleThumbRepaint(Thumbnail *thumb)
 {
-    XCopyArea(_dpy, _buffer->pixmap(), _win, _gc,
-        0, 0, _width, _height, 0, 0
-    );
+    if (! thumb->repaintPending())
+    {
+        thumb->setRepaintPending(true);
+        _dirtyThumbnails.append(thumb);
+    }
+
+    scheduleFrame();
 }
 
 
-void TeleWindow::onThumbRedrawed(Thumbnail *thumb)
+void TeleWindow::scheduleFrame()
+{
+    if (_frameTimeout)
+        return;
+
+    int rate = _shown ?
+        Settings::instance()->repaintRate() :
+        Settings::instance()->backgroundRefreshRate();
+
+    double delay = _lastFrameTime + 1.0 / rate - XEventLoop::currentTime();
+    if (delay < 0)
+        delay = 0;
+
+    _frameTimeout = XEventLoop::instance()->addTimeout(delay,
+        Delegate(this, &TeleWindow::onFrameTimeout));
+}
+
+
+void TeleWindow::onFrameTimeout(Timeout *timeout)
+{
+    _frameTimeout = 0;
+
+    flushFrame();
+}
+
+
+void TeleWindow::cancelFrame()
+{
+    if (_frameTimeout)
+    {
+        XEventLoop::instance()->cancelTimeout(_frameTimeout);
+        _frameTimeout = 0;
+    }
+}
+
+
+void TeleWindow::flushFrame()
+{
+    if (! _shown)
+    {
+        refreshInBackground();
+        return;
+    }
+
+    double now = XEventLoop::currentTime();
+
+    // Noisy client may not be repainted more often than this
+    double minInterval = 1.0 / Settings::instance()->repaintWindowRate();
+
+    bool frameEmpty = true;
+
+    int count = _dirtyThumbnails.size();
+    for (int n = 0; n < count; ++n)
+    {
+        Thumbnail *thumb = *_dirtyThumbnails.head();
+        _dirtyThumbnails.remove(0);
+
+        if (now - thumb->lastRepaintTime() < minInterval)
+        {
+            // Leaving it for one of the next frames
+            _dirtyThumbnails.append(thumb);
+            continue;
+        }
+
+        thumb->drawPreview();
+
+        XserverRegion damage = thumb->damageRegion();
+        if (damage)
+        {
+            XRectangle box;
+            box.x = thumb->x();
+            box.y = thumb->y();
+            box.width = thumb->width();
+            box.height = thumb->height();
+            _contentNode->content()->invalidate(damage, box);
+        }
+        else
+            thumb->node()->invalidate();
+
+        frameEmpty = false;
+
+        thumb->clearDamage();
+        thumb->setRepaintPending(false);
+        thumb->setLastRepaintTime(now);
+    }
+
+    if (! frameEmpty)
+        renderScene();
+
+    // Even empty frame counts, otherwise deferred thumbnails
+    // would make us spin
+    _lastFrameTime = now;
+
+    if (_dirtyThumbnails.size() > 0)
+        scheduleFrame();
+}
+
+
+void TeleWindow::refreshInBackground()
 {
-    blitThumb(thumb);
-    blitBuffer();
+    if (! Settings::instance()->backgroundRefresh())
+        return;
+
+    double now = XEventLoop::currentTime();
+
+    double minInterval = 1.0 / Settings::instance()->backgroundRefreshRate();
+
+    // Limiting work per tick so background refresh never stalls event
+    // handling for long
+    int budget = Settings::instance()->backgroundRefreshBudget();
+
+    int count = _dirtyThumbnails.size();
+    for (int n = 0; n < count && budget > 0; ++n)
+    {
+        Thumbnail *thumb = *_dirtyThumbnails.head();
+        _dirtyThumbnails.remove(0);
+
+        if (now - thumb->lastRepaintTime() < minInterval)
+        {
+            _dirtyThumbnails.append(thumb);
+            continue;
+        }
+
+        // Only thumbnail image is updated, nothing is on screen now
+        thumb->drawPreview();
+        thumb->clearDamage();
+        thumb->setRepaintPending(false);
+        thumb->setLastRepaintTime(now);
+
+        budget--;
+    }
+
+    _lastFrameTime = now;
+
+    if (_dirtyThumbnails.size() > 0)
+        scheduleFrame();
+}
+
+
+void TeleWindow::discardScheduledRepaints()
+{
+    cancelFrame();
+
+    // Damage that wasn't painted will be picked up by the next paint()
+    for (Vector<Thumbnail*>::Iter i = _dirtyThumbnails.head(); i; ++i)
+    {
+        (*i)->invalidatePreview();
+        (*i)->setRepaintPending(false);
+    }
+    _dirtyThumbnails.clear();
 }
 
 
@@ -625,6 +1142,7 @@ void TeleWindow::onHotKeyPress()
 void TeleWindow::onHotKeyRelease()
 {
     char keysPressed[32];
+    XEventLoop::countRoundTrip();
     XQueryKeymap(_dpy, keysPressed);
     if ( (keysPressed[_hotKeyCode >> 3] >> (_hotKeyCode & 0x07)) & 0x01)
         return;
@@ -636,24 +1154,43 @@ void TeleWindow::onHotKeyRelease()
 
 void TeleWindow::onButtonPress(XButtonEvent *event)
 {
-    _wasScrolling = false;
+    // Tap on moving content only stops it
+    _wasScrolling = _kineticTimeout != 0;
+    stopKinetic();
+
     _buttonPressed = true;
     _buttonPressX = event->x;
     _buttonPressY = event->y;
     _scrollBaseX = _scrollX;
     _scrollBaseY = _scrollY;
+
+    _lastMotionTime = event->time / 1000.0;
+    _lastMotionY = event->y;
 }
 
 void TeleWindow::onButtonRelease(XButtonEvent *event)
 {
     _buttonPressed = false;
 
-    if (! _wasScrolling)
+    if (_wasScrolling)
+    {
+        // Finger has stopped before release
+        if (event->time / 1000.0 - _lastMotionTime > 0.1)
+            _velocityY = 0;
+
+        if (fabs(_velocityY) >= KINETIC_MIN_VELOCITY)
+            startKinetic();
+    }
+    else
     {
         bool missed = true;
 
-        for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
-            if ((*i)->handleMousePress(event->x, event->y))
+        // Thumbnails are in surface coordinates
+        int x = event->x - _contentNode->offsetX();
+        int y = event->y - _contentNode->offsetY();
+
+        for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+            if ((*i)->handleMousePress(x, y))
             {
                 missed = false;
                 break;
@@ -672,8 +1209,8 @@ void TeleWindow::onButtonMotion(XMotionEvent *event)
 {
     if (_buttonPressed && Settings::instance()->scrollingEnabled())
     {
-        _scrollX = _scrollBaseX + event->x - _buttonPressX;
-        _scrollY = _scrollBaseY + event->y - _buttonPressY;
+        scrollTo(_scrollBaseX + event->x - _buttonPressX,
+                 _scrollBaseY + event->y - _buttonPressY);
 
         if (! _wasScrolling)
         {
@@ -682,20 +1219,85 @@ void TeleWindow::onButtonMotion(XMotionEvent *event)
                 _wasScrolling = true;
         }
 
+        // Velocity is smoothed, touchscreen events are jittery
+        double time = event->time / 1000.0;
+        if (time > _lastMotionTime)
+        {
+            double velocity = (event->y - _lastMotionY) / (time - _lastMotionTime);
+            _velocityY = 0.8 * velocity + 0.2 * _velocityY;
 
-//        paint();
-        _repaintOnIdle = true;
+            _lastMotionTime = time;
+            _lastMotionY = event->y;
+        }
     }
 }
 
 
-void TeleWindow::onIdle()
+void TeleWindow::startKinetic()
 {
-    if (_repaintOnIdle)
+    _kineticY = _scrollY;
+    _kineticTime = XEventLoop::currentTime();
+
+    if (_kineticTimeout == 0)
+        _kineticTimeout = XEventLoop::instance()->addTimeout(
+            1.0 / Settings::instance()->repaintRate(),
+            Delegate(this, &TeleWindow::onKineticFrame));
+}
+
+
+void TeleWindow::stopKinetic()
+{
+    if (_kineticTimeout)
     {
-        paint();
-        _repaintOnIdle = false;
+        XEventLoop::instance()->cancelTimeout(_kineticTimeout);
+        _kineticTimeout = 0;
+    }
+
+    _velocityY = 0;
+}
+
+
+void TeleWindow::onKineticFrame(Timeout *timeout)
+{
+    _kineticTimeout = 0;
+
+    // Time-based, so slow frames don't slow scrolling down
+    double now = XEventLoop::currentTime();
+    double dt = now - _kineticTime;
+    _kineticTime = now;
+
+    double speed = fabs(_velocityY) - KINETIC_DECELERATION * dt;
+    if (speed <= 0)
+    {
+        _velocityY = 0;
+        return;
     }
+    _velocityY = _velocityY > 0 ? speed : -speed;
+
+    _kineticY += _velocityY * dt;
+    scrollTo(_scrollX, (int)round(_kineticY));
+
+    // Only surface offset has changed, this is one composite
+    renderScene();
+
+    // Stopped by the end of content
+    if (_scrollY != (int)round(_kineticY))
+    {
+        _velocityY = 0;
+        return;
+    }
+
+    _kineticTimeout = XEventLoop::instance()->addTimeout(
+        1.0 / Settings::instance()->repaintRate(),
+        Delegate(this, &TeleWindow::onKineticFrame));
+}
+
+
+void TeleWindow::onIdle()
+{
+    // Exposed areas
+    if (_shown && _scene->damaged())
+        renderScene();
 }
 
 
@@ -726,7 +1328,7 @@ void TeleWindow::internalCommand(const char *action)
             {
                 int index = 0;
                 bool changed = false;
-                for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i, ++index)
+                for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i, ++index)
                     if ((*i) == _activeThumbnail)
                     {
                         if (index < _thumbnails.size() - 1)
@@ -741,10 +1343,7 @@ void TeleWindow::internalCommand(const char *action)
                     _activeThumbnail = *_thumbnails.head();
             }
 
-            if (_activeThumbnail) _activeThumbnail->redraw();
-            if (prevActiveThumbnail) prevActiveThumbnail->redraw();
-
-            paint();
+            selectionChanged(prevActiveThumbnail);
         }
     }
     else if (strcmp(action, "selectPrev") == 0)
@@ -761,7 +1360,7 @@ void TeleWindow::internalCommand(const char *action)
             {
                 int index = 0;
                 bool changed = false;
-                for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i, ++index)
+                for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i, ++index)
                     if ((*i) == _activeThumbnail)
                     {
                         if (index > 0)
@@ -776,10 +1375,7 @@ void TeleWindow::internalCommand(const char *action)
                     _activeThumbnail = *_thumbnails.tail();
             }
 
-            if (_activeThumbnail) _activeThumbnail->redraw();
-            if (prevActiveThumbnail) prevActiveThumbnail->redraw();
-
-            paint();
+            selectionChanged(prevActiveThumbnail);
         }
     }
     else if (   strcmp(action, "selectRight") == 0
@@ -805,10 +1401,7 @@ void TeleWindow::internalCommand(const char *action)
             if (newThumbnail)
                 _activeThumbnail = newThumbnail;
 
-            if (_activeThumbnail) _activeThumbnail->redraw();
-            if (prevActiveThumbnail) prevActiveThumbnail->redraw();
-
-            paint();
+            selectionChanged(prevActiveThumbnail);
         }
     }
     else
@@ -826,7 +1419,7 @@ Thumbnail* TeleWindow::findThumbnailByCoords(
     Thumbnail *foundThumb = 0;
     int max = INT_MAX;
 
-    for (LinkedList<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
+    for (Vector<Thumbnail*>::Iter i = _thumbnails.head(); i; ++i)
     {
         Thumbnail *thumb = *i;
 
@@ -865,6 +1458,8 @@ void TeleWindow::setNewSize(int width, int height)
     recreateBuffer();
 
     Resources::instance()->reloadWallpaper();
+    _wallpaperNode.setGeometry(0, 0, _width, _height);
+    _contentNode->setGeometry(0, 0, _width, _height);
 
     layoutThumbnails();
 }
@@ -877,6 +1472,7 @@ void TeleWindow::recreateBuffer()
         delete _buffer;
 
     _buffer = new Image(_dpy, _width, _height, DefaultDepth(_dpy, DefaultScreen(_dpy)));
+    _scene->setBuffer(_buffer);
 }
 
 
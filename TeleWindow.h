@@ -14,12 +14,15 @@
 
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrender.h>
+#include <X11/extensions/Xfixes.h>
 #include <X11/Xft/Xft.h>
 
 #include <Imlib2.h>
 
-#include "LinkedList.h"
+#include "Vector.h"
+#include "HashMap.h"
 #include "Mappings.h"
+#include "Scene.h"
 
 #include "XEventHandler.h"
 #include "XIdleTask.h"
@@ -27,6 +30,8 @@
 
 class Image;
 class Thumbnail;
+struct WindowInfo;
+class Timeout;
 
 class TeleWindow: public XEventHandler, public XIdleTask
 {
@@ -35,9 +40,16 @@ class TeleWindow: public XEventHandler, public XIdleTask
         Window _rootWindow;
         Window _win;
 
-        LinkedList<Thumbnail*> _thumbnails;
+        Vector<Thumbnail*> _thumbnails;
+        HashMap<Window, Thumbnail*> _thumbnailsByWindow;
         bool _thumbnailsListDirty;
 
+        // Last seen _NET_CLIENT_LIST and _NET_WM_WINDOW_TYPE of its windows.
+        // Type is refetched only after PropertyNotify on that window
+        Vector<Window> _clientList;
+        HashMap<Window, Atom> _windowTypes;
+        bool _windowTypesChanged;
+
         int _width;
         int _height;
         bool _shown;
@@ -51,6 +63,16 @@ class TeleWindow: public XEventHandler, public XIdleTask
         XftFont *_xftFont;
         Image* _buffer;
 
+        // Wallpaper with thumbnails on top. Thumbnails are composed into
+        // surface of _contentNode, which covers visible part of the
+        // content and some of it above and below. _surfaceTop is content
+        // coordinate of surface top
+        Scene *_scene;
+        WallpaperNode _wallpaperNode;
+        ScrollNode *_contentNode;
+        int _surfaceTop;
+        void placeSurface();
+
 
         XRenderColor _borderColor;
         XRenderColor _borderActiveColor;
@@ -62,12 +84,48 @@ class TeleWindow: public XEventHandler, public XIdleTask
         bool _buttonPressed;
         bool _wasScrolling;
         int _buttonPressX, _buttonPressY;
-        bool _repaintOnIdle;
+
+        // Height of all laid out thumbnails, more than window height only
+        // if they don't fit at minimal size
+        int _contentHeight;
+        void clampScroll(int *x, int *y);
+        void scrollTo(int x, int y);
+        void ensureVisible(Thumbnail *thumb);
+        // Pauses previews far from the screen and resumes ones coming
+        // close to it
+        void updateViewport();
+
+        // Kinetic scrolling continues with velocity of the drag, slowing
+        // down until it stops
+        Timeout *_kineticTimeout;
+        double _velocityY;      // pixels per second
+        double _lastMotionTime;
+        int _lastMotionY;
+        double _kineticY;
+        double _kineticTime;
+        void startKinetic();
+        void stopKinetic();
+        void onKineticFrame(Timeout *timeout);
 
 
         Thumbnail *_activeThumbnail;
 
 
+        // Thumbnails waiting for the next frame. Their damage goes to the
+        // scene when it comes
+        Vector<Thumbnail*> _dirtyThumbnails;
+        Timeout *_frameTimeout;
+        double _lastFrameTime;
+
+        void scheduleFrame();
+        void onFrameTimeout(Timeout *timeout);
+        void flushFrame();
+        void cancelFrame();
+        // Updates thumbnail images while switcher is hidden
+        void refreshInBackground();
+        void discardScheduledRepaints();
+
+
         Mappings _mappings;
 
 
@@ -84,8 +142,10 @@ class TeleWindow: public XEventHandler, public XIdleTask
 
         void animate(Thumbnail *thumb, bool toSmall);
 
-        void blitThumb(Thumbnail *thumbnail);
-        void blitBuffer();
+        // Puts invalidated part of the scene on screen
+        void renderScene();
+
+        void selectionChanged(Thumbnail *prevActiveThumbnail);
 
         Thumbnail* findThumbnailByCoords(
             Thumbnail *orig,
@@ -114,15 +174,24 @@ class TeleWindow: public XEventHandler, public XIdleTask
 
         Thumbnail* activeThumbnail() { return _activeThumbnail; }
 
+        void addThumbnail(WindowInfo *info);
         void removeThumbnail(Thumbnail *thumb);
+        // Drops all references to thumbnail except _thumbnails list
+        void forgetThumbnail(Thumbnail *thumb);
 
         void onRootEvent(XEvent *event);
         void onTeleWindowEvent(XEvent *event);
 
+        // Brings previews of thumbnails near the screen up to date
+        void updatePreviews();
+        // Updates previews and repaints everything
         void paint();
 
         void onThumbRedrawed(Thumbnail *thumb);
 
+        // Queues damaged thumbnail to be repainted with the next frame
+        void scheduleThumbRepaint(Thumbnail *thumb);
+
         void internalCommand(const char *action);
 
         void markThumbnailsListDirty();
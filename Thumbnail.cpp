@@ -17,18 +17,23 @@
 #include "Settings.h"
 #include "Resources.h"
 #include "Image.h"
+#include "Trace.h"
 
 
-Thumbnail::Thumbnail(TeleWindow *teleWindow, Window clientWindow)
+Thumbnail::Thumbnail(TeleWindow *teleWindow, WindowInfo *info)
+    : _node(Delegate(this, &Thumbnail::drawNode))
 {
     _teleWindow = teleWindow;
     _dpy = teleWindow->display();
-    _clientWindow = clientWindow;
+    _clientWindow = info->window;
 
     _depth = DefaultDepth(_dpy, DefaultScreen(_dpy));
 
-    _title = XTools::windowTitle_alloc(_clientWindow);
-    _clientClass = XTools::windowClass_alloc(_clientWindow);
+    // Taking ownership of strings
+    _title = info->title;
+    _clientClass = info->clientClass;
+    info->title = 0;
+    info->clientClass = 0;
 
 #ifdef MAEMO4
     _isOssoMediaPlayer = strcmp(_clientClass, "mediaplayer-ui") == 0;
@@ -42,32 +47,26 @@ Thumbnail::Thumbnail(TeleWindow *teleWindow, Window clientWindow)
 
     _clientDestroyed = false;
 
-    XSelectInput(_dpy, _clientWindow, StructureNotifyMask | PropertyChangeMask);
+    // Event mask of client window is managed by TeleWindow
 
 
-    _damage = XDamageCreate(_dpy, _clientWindow, XDamageReportNonEmpty);
+    // BoundingBox level makes every notify carry the whole damaged area
+    // accumulated since the last XDamageSubtract, so we never have to fetch
+    // the damage region from the server
+    _damage = XDamageCreate(_dpy, _clientWindow, XDamageReportBoundingBox);
 
+    _damageRegion = XFixesCreateRegion(_dpy, 0, 0);
+    _scratchRegion = XFixesCreateRegion(_dpy, 0, 0);
+    _previewDamaged = false;
 
-    XWindowAttributes attrs;
-    XGetWindowAttributes(_dpy, _clientWindow, &attrs);
 
 #ifdef DESKTOP
-    Window root;
-    Window parent;
-    Window *children;
-    unsigned int nchildren;
-    XQueryTree(_dpy, _clientWindow, &root, &parent, &children, &nchildren);
-    XFree(children);
-
-    XWindowAttributes decoAttrs;
-    XGetWindowAttributes(_dpy, parent, &decoAttrs);
-
-    _clientDecoX = decoAttrs.x;
-    _clientDecoY = decoAttrs.y;
+    _clientDecoX = info->decoX;
+    _clientDecoY = info->decoY;
 #else
     #ifdef MAEMO4
-        _clientDecoX = attrs.x;
-        _clientDecoY = attrs.y;
+        _clientDecoX = info->x;
+        _clientDecoY = info->y;
     #else
         #error Unknown window manager
     #endif
@@ -77,13 +76,26 @@ Thumbnail::Thumbnail(TeleWindow *teleWindow, Window clientWindow)
     _previewValid = false;
     _previewOnceDrawn = false;
 
+    _scale = 1.0;
+
+    _repaintPending = false;
+    _lastRepaintTime = 0;
+
+    _paused = false;
+
 
     // First setGeometry call will compare this with new dimensions
     _width = -1;
     _height = -1;
 
+    // Kept current by ConfigureNotify, layout never asks the server
+    _clientX = info->x;
+    _clientY = info->y;
+    _clientWidth = info->width;
+    _clientHeight = info->height;
+
 
-    _minimized = XTools::checkIfWindowMinimized(_clientWindow);
+    _minimized = info->minimized;
 
 
     XRenderPictureAttributes pa;
@@ -102,9 +114,11 @@ Thumbnail::~Thumbnail()
 
     delete _image;
 
+    XFixesDestroyRegion(_dpy, _damageRegion);
+    XFixesDestroyRegion(_dpy, _scratchRegion);
+
     if (! _clientDestroyed)
     {
-        XSelectInput(_dpy, _clientWindow, 0);
         XDamageDestroy(_dpy, _damage);
         XRenderFreePicture(_dpy, _clientPict);
     }
@@ -136,6 +150,27 @@ void Thumbnail::setGeometry(int x, int y, int w, int h)
         _width = w;
         _height = h;
     }
+
+    _node.setGeometry(x, y, w, h);
+}
+
+void Thumbnail::move(int dx, int dy)
+{
+    _fitX += dx;
+    _fitY += dy;
+
+    setGeometry(_x + dx, _y + dy, _width, _height);
+}
+
+void Thumbnail::drawNode(Picture dest)
+{
+    XRenderComposite(_dpy, PictOpOver,
+        _image->picture(), None, dest,
+        0, 0,
+        0, 0,
+        _x, _y,
+        _width, _height
+    );
 }
 
 bool Thumbnail::inside(int x, int y)
@@ -147,14 +182,25 @@ void Thumbnail::onClientEvent(XEvent *event)
 {
     if (event->type == XTools::damageEventBase() + XDamageNotify)
     {
-        _previewValid = false;
-        if (_teleWindow->shown())
+        XDamageNotifyEvent *damageEvent = (XDamageNotifyEvent*)event;
+
+        // Subtracting before compositing: everything damaged after this
+        // point will be reported by next notify
+        XDamageSubtract(_dpy, damageEvent->damage, None, None);
+
+        // In background refresh mode previews are kept current while
+        // switcher is hidden, at lower rate
+        if (! _paused &&
+            (_teleWindow->shown() || Settings::instance()->backgroundRefresh()))
         {
-            drawPreview();
-            _teleWindow->onThumbRedrawed(this);
-        }
+            // If preview is already invalid it will be redrawn entirely
+            if (_previewValid)
+                addDamage(&damageEvent->area);
 
-        XDamageSubtract(_dpy, ((XDamageNotifyEvent*)event)->damage, None, None);
+            _teleWindow->scheduleThumbRepaint(this);
+        }
+        else
+            invalidatePreview();
     }
     else if (event->type == ConfigureNotify)
     {
@@ -193,12 +239,6 @@ void Thumbnail::tryFitIn(int rx, int ry, int rwidth, int rheight,
     int borderWidth = Settings::instance()->borderWidth();
     int headerHeight = Resources::instance()->headerMiddle()->height();
 
-    XWindowAttributes attrs;
-    XGetWindowAttributes(_dpy, _clientWindow, &attrs);
-
-    _clientWidth = attrs.width;
-    _clientHeight= attrs.height;
-
     // Thumb width if limited in horizontal direction
     int horWidth = rwidth;
 
@@ -261,15 +301,9 @@ void Thumbnail::onResize()
         DefaultColormap(_dpy, DefaultScreen(_dpy)));
 
 
-    XWindowAttributes attrs;
-    XGetWindowAttributes(_dpy, _clientWindow, &attrs);
-
-    _clientWidth = attrs.width;
-    _clientHeight= attrs.height;
-
 #ifdef MAEMO4
-    _clientDecoX = attrs.x;
-    _clientDecoY = attrs.y;
+    _clientDecoX = _clientX;
+    _clientDecoY = _clientY;
 #endif
 
     int borderWidth = Settings::instance()->borderWidth();
@@ -284,6 +318,7 @@ void Thumbnail::onResize()
 
     double scale = _clientScaledWidth;
     scale /= _clientWidth;
+    _scale = scale;
 
     _clientDecoXScaled = (int)round(scale * _clientDecoX);
     _clientDecoYScaled = (int)round(scale * _clientDecoY);
@@ -352,14 +387,96 @@ void Thumbnail::onResize()
 
 void Thumbnail::onClientResize(XEvent *event)
 {
+    // Synthetic notify from window manager has position in root
+    // coordinates, size is right in both
+    if (! event->xconfigure.send_event)
+    {
+        _clientX = event->xconfigure.x;
+        _clientY = event->xconfigure.y;
+    }
+    _clientWidth = event->xconfigure.width;
+    _clientHeight = event->xconfigure.height;
+
     fitIn(_fitX, _fitY, _fitWidth, _fitHeight);
 }
 
 
+void Thumbnail::addDamage(const XRectangle *area)
+{
+    // Mapping client window rectangle into _image coordinates the same way
+    // as the XRenderComposite in drawPreview() does
+    int srcX = _clientDecoXScaled - _clientDecoX;
+    int srcY = _clientDecoYScaled - _clientDecoY;
+
+    int x1 = _clientOffsetX - srcX + (int)floor(area->x * _scale);
+    int y1 = _clientOffsetY - srcY + (int)floor(area->y * _scale);
+    int x2 = _clientOffsetX - srcX + (int)ceil((area->x + area->width) * _scale);
+    int y2 = _clientOffsetY - srcY + (int)ceil((area->y + area->height) * _scale);
+
+    if (x1 < _clientOffsetX) x1 = _clientOffsetX;
+    if (y1 < _clientOffsetY) y1 = _clientOffsetY;
+    if (x2 > _clientOffsetX + _clientScaledWidth) x2 = _clientOffsetX + _clientScaledWidth;
+    if (y2 > _clientOffsetY + _clientScaledHeight) y2 = _clientOffsetY + _clientScaledHeight;
+
+    if (x1 >= x2 || y1 >= y2)
+        return;
+
+    XRectangle rect;
+    rect.x = x1;
+    rect.y = y1;
+    rect.width = x2 - x1;
+    rect.height = y2 - y1;
+
+    if (_previewDamaged)
+    {
+        XFixesSetRegion(_dpy, _scratchRegion, &rect, 1);
+        XFixesUnionRegion(_dpy, _damageRegion, _damageRegion, _scratchRegion);
+    }
+    else
+    {
+        XFixesSetRegion(_dpy, _damageRegion, &rect, 1);
+        _previewDamaged = true;
+    }
+}
+
+
+void Thumbnail::clearDamage()
+{
+    _previewDamaged = false;
+}
+
+
+void Thumbnail::invalidatePreview()
+{
+    _previewValid = false;
+    _previewDamaged = false;
+}
+
+
 void Thumbnail::drawPreview()
 {
+    TraceScope trace("drawPreview", _clientWindow);
+
+    if (_previewValid && _previewDamaged && ! _minimized)
+    {
+        // Only part of client was changed, recompositing just it
+        XFixesSetPictureClipRegion(_dpy, _image->picture(), 0, 0, _damageRegion);
+
+        XRenderComposite(_dpy, PictOpSrc,
+                _clientPict, None, _image->picture(),
+                _clientDecoXScaled-_clientDecoX, _clientDecoYScaled - _clientDecoY,
+                0, 0,
+                _clientOffsetX, _clientOffsetY,
+                _clientScaledWidth, _clientScaledHeight);
+
+        XFixesSetPictureClipRegion(_dpy, _image->picture(), 0, 0, None);
+    }
+
     if (! _previewValid)
     {
+        // Whole thumbnail is going to be repainted
+        _previewDamaged = false;
+
         if (! _minimized)
         {
             XRenderComposite(_dpy, PictOpSrc,
@@ -392,6 +509,8 @@ void Thumbnail::drawPreview()
 
 void Thumbnail::redraw()
 {
+    TraceScope trace("redraw", _clientWindow);
+
     int borderWidth = Settings::instance()->borderWidth();
     int headerHeight = Resources::instance()->headerMiddle()->height();
     int headerLeftWidth = Resources::instance()->headerLeft()->width();
@@ -14,12 +14,15 @@
 
 #include <X11/Xlib.h>
 #include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
 #include <X11/extensions/Xrender.h>
 #include <X11/Xft/Xft.h>
 
+#include "Scene.h"
 
 class TeleWindow;
 class Image;
+struct WindowInfo;
 
 class Thumbnail
 {
@@ -37,6 +40,12 @@ class Thumbnail
 
         Damage _damage;
 
+        // Damaged part of the preview in _image coordinates. Valid only
+        // while _previewDamaged is true
+        XserverRegion _damageRegion;
+        XserverRegion _scratchRegion;
+        bool _previewDamaged;
+
         Picture _clientPict;
 
         int _depth;
@@ -48,18 +57,31 @@ class Thumbnail
         int _fitX, _fitY;
         int _fitWidth, _fitHeight;
 
+        DelegateNode _node;
+        void drawNode(Picture dest);
+
+        // Client geometry as of the last ConfigureNotify
+        int _clientX, _clientY;
         int _clientWidth, _clientHeight;
         int _clientScaledWidth, _clientScaledHeight;
 
         int _clientDecoX, _clientDecoY;
         int _clientDecoXScaled, _clientDecoYScaled;
 
+        double _scale;
+
         int _clientOffsetX, _clientOffsetY;
 
         bool _clientDestroyed;
 
         bool _minimized;
 
+        bool _repaintPending;
+        double _lastRepaintTime;
+
+        // Far from the visible part of scrolled TeleWindow
+        bool _paused;
+
 #ifdef MAEMO4
         bool _isOssoMediaPlayer;
         bool _isLiqBase;
@@ -69,8 +91,11 @@ class Thumbnail
         void onResize();
         void onClientResize(XEvent *event);
 
+        void addDamage(const XRectangle *area);
+
     public:
-        Thumbnail(TeleWindow *teleWindow, Window clientWindow);
+        // Takes ownership of info->title and info->clientClass
+        Thumbnail(TeleWindow *teleWindow, WindowInfo *info);
         ~Thumbnail();
 
 //        Window window();
@@ -78,12 +103,17 @@ class Thumbnail
 
         Image* image() { return _image; }
 
+        // Thumbnail image in TeleWindow's scene
+        SceneNode* node() { return &_node; }
+
         void setClientDestroyed(bool clientDestroyed) { _clientDestroyed = clientDestroyed; }
 
         const char* title() { return _title; }
         const char* clientClass() { return _clientClass; }
 
         void setGeometry(int x, int y, int w, int h);
+        // Scrolling, size stays the same
+        void move(int dx, int dy);
         void fitIn(int rx, int ry, int rwidth, int rheight);
         void tryFitIn(int rx, int ry, int rwidth, int rheight,
             int *x, int *y, int *width, int *height);
@@ -116,6 +146,26 @@ class Thumbnail
         void drawPreview();
         void redraw();
 
+        // Region of the thumbnail changed by the last drawPreview() or
+        // None if the whole thumbnail must be repainted
+        XserverRegion damageRegion() { return _previewDamaged ? _damageRegion : None; }
+        void clearDamage();
+
+        // Forgets accumulated damage, next drawPreview() will redraw
+        // whole preview
+        void invalidatePreview();
+        bool previewValid() { return _previewValid; }
+
+        // Used by TeleWindow's repaint scheduler
+        bool repaintPending() { return _repaintPending; }
+        void setRepaintPending(bool pending) { _repaintPending = pending; }
+        double lastRepaintTime() { return _lastRepaintTime; }
+        void setLastRepaintTime(double time) { _lastRepaintTime = time; }
+
+        // Paused preview is not updated, client damage only invalidates it
+        bool paused() { return _paused; }
+        void setPaused(bool paused) { _paused = paused; }
+
         bool handleMousePress(int x, int y);
 
         void switchToClient();
@@ -0,0 +1,57 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+#include "Trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "XEventLoop.h"
+
+
+FILE* Trace::_out = 0;
+
+
+void Trace::init()
+{
+    const char *fileName = getenv("TELESCOPE_TRACE");
+    if (fileName == 0 || *fileName == '\0')
+        return;
+
+    if (strcmp(fileName, "-") == 0)
+        _out = stderr;
+    else
+    {
+        _out = fopen(fileName, "w");
+        if (! _out)
+            perror("Cannot open trace file");
+    }
+}
+
+
+void Trace::done()
+{
+    if (_out && _out != stderr)
+        fclose(_out);
+    _out = 0;
+}
+
+
+void Trace::record(char kind, const char *name, unsigned long window)
+{
+    double time = XEventLoop::currentTime();
+
+    if (window)
+        fprintf(_out, "%.6f %c %s 0x%lx\n", time, kind, name, window);
+    else
+        fprintf(_out, "%.6f %c %s\n", time, kind, name);
+
+    // Log is read by benchmark while we are running
+    fflush(_out);
+}
@@ -0,0 +1,68 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+// Trace - latency tracing of show/paint phases
+//
+// Enabled by TELESCOPE_TRACE environment variable, which holds name of
+// the log file ("-" means stderr). Every record is one line:
+//
+//     <seconds> <kind> <name> [<window>]
+//
+// where seconds is monotonic time with microsecond precision and kind is
+// B (phase begins), E (phase ends) or I (instant event). Window is the
+// client window id in hex for per-thumbnail phases.
+
+#ifndef __TELESCOPE_TRACE_H
+#define __TELESCOPE_TRACE_H
+
+#include <stdio.h>
+
+class Trace
+{
+    private:
+        static FILE *_out;
+
+        static void record(char kind, const char *name, unsigned long window);
+
+    public:
+        // Reads TELESCOPE_TRACE and opens the log
+        static void init();
+        static void done();
+
+        static bool enabled() { return _out != 0; }
+
+        static void begin(const char *name, unsigned long window = 0)
+        { if (_out) record('B', name, window); }
+
+        static void end(const char *name, unsigned long window = 0)
+        { if (_out) record('E', name, window); }
+
+        static void instant(const char *name, unsigned long window = 0)
+        { if (_out) record('I', name, window); }
+};
+
+
+// Traces a phase lasting until the end of enclosing block
+class TraceScope
+{
+    private:
+        const char *_name;
+        unsigned long _window;
+
+    public:
+        TraceScope(const char *name, unsigned long window = 0)
+            : _name(name), _window(window)
+        { Trace::begin(_name, _window); }
+
+        ~TraceScope()
+        { Trace::end(_name, _window); }
+};
+
+
+#endif
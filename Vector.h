@@ -0,0 +1,364 @@
+/**
+ * @file Vector.h
+ *
+ * @brief Header and implementation of Vector<T>
+ *
+ * Vector<T> is implemented as template and fully defined in this
+ * header file
+ *
+ * $Id$
+ *
+ */
+
+#ifndef __VECTOR_H
+#define __VECTOR_H
+
+#include <assert.h>
+
+
+/// Implements the growable array of elements of type T
+/**
+ * Elements are stored by value in contiguous memory. First N elements are
+ * stored inside of Vector object itself, so short lists do not allocate
+ * memory at all.
+ *
+ * Iterators are plain indices: inserting or removing an element shifts
+ * elements under all iterators but the one passed to remove(Iter&). That
+ * one is moved to the previous element, so removing current element
+ * during iteration is safe:
+ * @code
+ * for (Vector<T>::Iter i = vector.head(); i; ++i)
+ *     if (shouldRemove(*i))
+ *         vector.remove(i);
+ * @endcode
+ *
+ * @warning T must have default constructor and assignment operator
+ */
+template <class T, int N = 8>
+class Vector
+{
+    public:
+        class Iter;
+
+    private:
+        T m_inline[N];  ///< Storage for first N elements
+        T *m_data;      ///< Points either to m_inline or to heap buffer
+        int m_size;     ///< Current number of elements
+        int m_capacity; ///< Number of elements m_data can hold
+
+        /// Makes sure that m_data can hold at least \c capacity elements
+        void reserve(int capacity)
+        {
+            if (capacity <= m_capacity)
+                return;
+
+            int newCapacity = m_capacity * 2;
+            if (newCapacity < capacity)
+                newCapacity = capacity;
+
+            T *newData = new T[newCapacity];
+            for (int i = 0; i < m_size; ++i)
+                newData[i] = m_data[i];
+
+            if (m_data != m_inline)
+                delete[] m_data;
+
+            m_data = newData;
+            m_capacity = newCapacity;
+        }
+
+    public:
+        /// Iterator for vector
+        /**
+         * Can be used for iterating over vector in STL-like way:
+         * @code
+         * for (Vector<T>::Iter i = vector.head(); i; ++i)
+         *     doSomething(*i);
+         * @endcode
+         */
+        class Iter
+        {
+            private:
+                /// Vector<T> needs to create Iter and move it in remove()
+                friend class Vector<T, N>;
+
+                const Vector<T, N> *m_vector; ///< Iterated vector
+                int m_index;                  ///< Index of referenced element
+
+                /// Constructor
+                Iter(const Vector<T, N> *vector, int index)
+                    : m_vector(vector), m_index(index)
+                { }
+
+            public:
+                /// Casting to bool
+                /**
+                 * @return true if Iterator pointing to valid element
+                 */
+                operator bool() const
+                {
+                    return m_index >= 0 && m_index < m_vector->m_size;
+                }
+
+                /// Returns index of referenced element
+                int index() const
+                {
+                    return m_index;
+                }
+
+                /// Returns value of referenced element
+                T& operator *()
+                {
+                    assert(*this);
+                    return m_vector->m_data[m_index];
+                }
+
+                /// Returns pointer to value of referenced element
+                T* operator ->()
+                {
+                    assert(*this);
+                    return &m_vector->m_data[m_index];
+                }
+
+                /// Moves iterator to next element
+                /**
+                 * If iterator points to last element, it will became invalid ((bool)iter == false)
+                 */
+                Iter& operator++ ()
+                {
+                    m_index++;
+                    return *this;
+                }
+
+                /// Moves iterator to previous element
+                /**
+                 * If iterator points to first element, it will became invalid ((bool)iter == false)
+                 */
+                Iter& operator-- ()
+                {
+                    m_index--;
+                    return *this;
+                }
+
+                /// Moves iterator to next element
+                /**
+                 * @note Prefix form is more effective
+                 */
+                Iter operator++ (int)
+                {
+                    Iter tmp(*this);
+                    m_index++;
+                    return tmp;
+                }
+
+                /// Moves iterator to previous element
+                /**
+                 * @note Prefix form is more effective
+                 */
+                Iter operator-- (int)
+                {
+                    Iter tmp(*this);
+                    m_index--;
+                    return tmp;
+                }
+
+                Iter& operator += (int n)
+                {
+                    m_index += n;
+                    return *this;
+                }
+        };
+
+        /// Creates an empty vector
+        Vector()
+        {
+            m_data = m_inline;
+            m_size = 0;
+            m_capacity = N;
+        }
+
+        /// Creates a copy of vector
+        Vector(const Vector<T, N>& other)
+        {
+            m_data = m_inline;
+            m_size = 0;
+            m_capacity = N;
+
+            reserve(other.m_size);
+            for (int i = 0; i < other.m_size; ++i)
+                m_data[i] = other.m_data[i];
+            m_size = other.m_size;
+        }
+
+        /// Deletes the vector
+        ~Vector()
+        {
+            if (m_data != m_inline)
+                delete[] m_data;
+        }
+
+        /// Replaces contents with a copy of other vector
+        Vector<T, N>& operator = (const Vector<T, N>& other)
+        {
+            if (this != &other)
+            {
+                clear();
+                reserve(other.m_size);
+                for (int i = 0; i < other.m_size; ++i)
+                    m_data[i] = other.m_data[i];
+                m_size = other.m_size;
+            }
+            return *this;
+        }
+
+        /// Returns current number of elements
+        int size() const
+        { return m_size; }
+
+        /// Returns iterator pointing to first element
+        /**
+         * @return Iterator pointing to first element. If vector is empty,
+         *                  returned iterator is invalid.
+         */
+        Iter head() const
+        {
+            return Iter(this, 0);
+        }
+
+        /// Returns iterator pointing to last element
+        /**
+         * @return Iterator pointing to last element. If vector is empty,
+         *                  returned iterator is invalid.
+         */
+        Iter tail() const
+        {
+            return Iter(this, m_size - 1);
+        }
+
+        /// Add value to the beginning of vector
+        void prepend(const T& value)
+        {
+            insert(0, value);
+        }
+
+        /// Add value to the end of vector
+        void append(const T& value)
+        {
+            if (m_size == m_capacity)
+            {
+                // value may refer to our own element
+                T copy = value;
+                reserve(m_size + 1);
+                m_data[m_size++] = copy;
+            }
+            else
+                m_data[m_size++] = value;
+        }
+
+        /// Add value before n'th element
+        void insert(int n, const T& value)
+        {
+            assert(n >= 0 && n <= m_size);
+
+            T copy = value;
+            reserve(m_size + 1);
+
+            for (int i = m_size; i > n; --i)
+                m_data[i] = m_data[i-1];
+            m_data[n] = copy;
+            m_size++;
+        }
+
+        /// Removes all elements
+        void clear()
+        {
+            for (int i = 0; i < m_size; ++i)
+                m_data[i] = T();
+            m_size = 0;
+        }
+
+        /// Removes n'th element
+        /**
+         * @param[in] index Index of element to remove. Must be
+         *      0 <= index < size(), otherwise method will fail.
+         */
+        void remove(int index)
+        {
+            assert(index >= 0 && index < m_size);
+
+            for (int i = index; i < m_size - 1; ++i)
+                m_data[i] = m_data[i+1];
+            m_size--;
+            m_data[m_size] = T();
+        }
+
+        /// Removes element by iterator
+        /**
+         * @param[in] iter Iterator pointing to the element to be deleted.
+         *                 Should not be invalid. After removal it points
+         *                 to the previous element.
+         */
+        void remove(Iter& iter)
+        {
+            assert(iter.m_vector == this);
+            remove(iter.m_index);
+            iter.m_index--;
+        }
+
+        /// Removes all elements equal to given value
+        /**
+         * Comparsion is done with == operator.
+         */
+        void removeByValue(const T& value)
+        {
+            T copy = value;
+            for (int i = m_size - 1; i >= 0; --i)
+                if (m_data[i] == copy)
+                    remove(i);
+        }
+
+        /// Checks whether the vector contains given value
+        /**
+         * Comparsion is done with == operator
+         */
+        bool contains(const T& value) const
+        {
+            for (int i = 0; i < m_size; ++i)
+                if (m_data[i] == value)
+                    return true;
+            return false;
+        }
+
+        /// Checks whether vectors have equal elements in the same order
+        /**
+         * Comparsion is done with == operator
+         */
+        bool operator == (const Vector<T, N>& other) const
+        {
+            if (m_size != other.m_size)
+                return false;
+
+            for (int i = 0; i < m_size; ++i)
+                if (! (m_data[i] == other.m_data[i]))
+                    return false;
+
+            return true;
+        }
+
+        /// Access value by it's index
+        inline const T& operator [](int index) const
+        {
+            assert(index >= 0 && index < m_size);
+            return m_data[index];
+        }
+
+        /// Access value by it's index
+        inline T& operator [](int index)
+        {
+            assert(index >= 0 && index < m_size);
+            return m_data[index];
+        }
+};
+
+
+#endif
@@ -1,7 +1,15 @@
 #include "XEventLoop.h"
 
-#include <math.h>
-#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #include "XEventHandler.h"
 #include "XIdleTask.h"
@@ -12,8 +20,14 @@
 #endif
 
 
+// Maximum number of ready descriptors taken from epoll at once
+#define MAX_EPOLL_EVENTS    16
+
+
 XEventLoop* XEventLoop::_instance = 0;
 
+unsigned int XEventLoop::_roundTrips = 0;
+
 
 XEventLoop::XEventLoop(Display *dpy)
 {
@@ -22,10 +36,64 @@ XEventLoop::XEventLoop(Display *dpy)
     _dpy = dpy;
 
     _breakEventLoop = false;
+
+    _roundTripsPerSecond = 0;
+    _statsStartTime = currentTime();
+    _statsStartRoundTrips = _roundTrips;
+
+
+    _timeoutsCount = 0;
+    _timeoutsCapacity = 16;
+    _timeouts = new Timeout*[_timeoutsCapacity];
+
+
+    _epollFd = epoll_create(16);
+    if (_epollFd < 0)
+        perror("epoll_create");
+    else
+        fcntl(_epollFd, F_SETFD, FD_CLOEXEC);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &_xSocketMarker;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, XConnectionNumber(_dpy), &ev) < 0)
+        perror("epoll_ctl(X socket)");
+
+    _timerFd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (_timerFd < 0)
+        perror("timerfd_create");
+    else
+    {
+        fcntl(_timerFd, F_SETFD, FD_CLOEXEC);
+        fcntl(_timerFd, F_SETFL, O_NONBLOCK);
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = &_timerMarker;
+        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, _timerFd, &ev) < 0)
+            perror("epoll_ctl(timerfd)");
+    }
+    _timerArmedTime = 0;
 }
 
 XEventLoop::~XEventLoop()
 {
+    for (int i = 0; i < _timeoutsCount; ++i)
+        delete _timeouts[i];
+    delete[] _timeouts;
+
+    for (Vector<WatchedFd*>::Iter i = _watchedFds.head(); i; ++i)
+        delete *i;
+    for (Vector<WatchedFd*>::Iter i = _fdWatches.head(); i; ++i)
+        delete *i;
+    for (Vector<WatchedFd*>::Iter i = _deadWatchedFds.head(); i; ++i)
+        delete *i;
+
+    if (_timerFd >= 0)
+        close(_timerFd);
+    if (_epollFd >= 0)
+        close(_epollFd);
+
+    _instance = 0;
 }
 
 
@@ -45,88 +113,100 @@ void XEventLoop::eventLoop()
 {
     XFlush(_dpy);
 
-    int xSocket = XConnectionNumber(_dpy);
-    fd_set fdset;
-
-    Timeout* nearestTimeout = 0;
-    struct timeval remaining;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
 
     _breakEventLoop = false;
     while (! _breakEventLoop)
     {
-        if (_timeouts.size() > 0)
+        fireTimeouts();
+        armTimer();
+
+
+        // Handlers, idle tasks and timeout callbacks may have queued some
+        // requests. Flushing is enough here, there is no need to wait for
+        // server to process them
+        XFlush(_dpy);
+
+        // If Xlib has already read some events into its queue, the
+        // socket may have nothing for us, so we must not block
+        bool haveQueuedEvents = QLength(_dpy) > 0;
+
+        int nEvents = epoll_wait(_epollFd, events, MAX_EPOLL_EVENTS,
+            haveQueuedEvents ? 0 : -1);
+
+        for (int i = 0; i < nEvents; ++i)
         {
-            nearestTimeout = 0;
+            WatchedFd *watchedFd = static_cast<WatchedFd*>(events[i].data.ptr);
+
+            if (watchedFd == &_xSocketMarker)
+                continue;   // X events are read below
 
-            while (_timeouts.size() > 0 && nearestTimeout == 0)
+            if (watchedFd == &_timerMarker)
             {
-                nearestTimeout = *_timeouts.head();
-                remaining = *nearestTimeout->absTime();
-                struct timeval cur;
-                gettimeofday(&cur, 0);
-
-                if (timercmp(&cur, &remaining, >))
-                {
-                    // already should be fired
-                    nearestTimeout->callback()(nearestTimeout);
-                    _timeouts.remove(0);
-                    continue;
-                }
-
-                timersub(&remaining, &cur, &remaining);
+                // Just resetting expiration counter, expired timeouts
+                // are fired on next iteration
+                uint64_t expirations;
+                if (read(_timerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                    perror("read(timerfd)");
+                _timerArmedTime = 0;
+                continue;
             }
+
+            if (! watchedFd->callback.empty())
+                watchedFd->callback(watchedFd->fd);
+            else
+                handleWatchedFd(watchedFd, events[i].events);
         }
-        else
-            nearestTimeout = 0;
 
+        // Watches removed by callbacks may still be referenced by
+        // remaining epoll events, so they are freed only here
+        for (Vector<WatchedFd*>::Iter i = _deadWatchedFds.head(); i; ++i)
+            delete *i;
+        _deadWatchedFds.clear();
 
-        FD_ZERO(&fdset);
-        FD_SET(xSocket, &fdset);
-        int maxSocket = xSocket;
 
-        for (LinkedList<DBusWatch*>::Iter i = _dbusWatches.head(); i; ++i)
-            if (dbus_watch_get_enabled(*i))
-            {
-                int dbusSocket = dbus_watch_get_unix_fd(*i);
-                FD_SET(dbusSocket, &fdset);
-                if (dbusSocket > maxSocket)
-                    maxSocket = dbusSocket;
-            }
-
-        if (select(maxSocket+1, &fdset, 0, 0, nearestTimeout ? &remaining : 0))
+        // Dispatching everything that has arrived before running idle
+        // tasks. XEventsQueued(QueuedAfterReading) reads socket only if
+        // it has data, so this never waits for server
+        while (XEventsQueued(_dpy, QueuedAfterReading) > 0)
         {
-            for (LinkedList<DBusWatch*>::Iter i = _dbusWatches.head(); i; ++i)
-                if (FD_ISSET(dbus_watch_get_unix_fd(*i), &fdset))
-                    dbus_watch_handle(*i, DBUS_WATCH_READABLE | DBUS_WATCH_WRITABLE);
-        }
-        else
-            if (nearestTimeout)
+            while (QLength(_dpy) > 0)
             {
-                _timeouts.remove(0);
-                nearestTimeout->callback()(nearestTimeout);
-                nearestTimeout = 0;
-            }
+                XEvent event;
+                XNextEvent(_dpy, &event);
 
+                for (Vector<XEventHandler*>::Iter i = _eventHandlers.head(); i; ++i)
+                    (*i)->onEvent(&event);
+            }
+        }
 
 
-        for (LinkedList<XIdleTask*>::Iter i = _idleTasks.head(); i; ++i)
+        for (Vector<XIdleTask*>::Iter i = _idleTasks.head(); i; ++i)
             (*i)->onIdle();
 
-        XSync(_dpy, False);
 
-        while (XPending(_dpy))
-        {
-            XEvent event;
-            XNextEvent(_dpy, &event);
+        updateRoundTripStats();
+    }
+}
 
-            for (LinkedList<XEventHandler*>::Iter i = _eventHandlers.head(); i; ++i)
-                (*i)->onEvent(&event);
 
-            for (LinkedList<XIdleTask*>::Iter i = _idleTasks.head(); i; ++i)
-                (*i)->onIdle();
+void XEventLoop::sync()
+{
+    countRoundTrip();
+    XSync(_dpy, False);
+}
 
-            XSync(_dpy, False);
-        }
+
+void XEventLoop::updateRoundTripStats()
+{
+    double now = currentTime();
+    double elapsed = now - _statsStartTime;
+
+    if (elapsed >= 1.0)
+    {
+        _roundTripsPerSecond = (unsigned int)((_roundTrips - _statsStartRoundTrips) / elapsed + 0.5);
+        _statsStartTime = now;
+        _statsStartRoundTrips = _roundTrips;
     }
 }
 
@@ -134,55 +214,162 @@ void XEventLoop::eventLoop()
 
 
 
-void addToTimeval(float sec, struct timeval *tv)
+Timeout* XEventLoop::addTimeout(float sec, TimeoutCallback callback)
+{
+    Timeout* timeout = new Timeout(currentTime() + sec, callback);
+
+    if (_timeoutsCount == _timeoutsCapacity)
+    {
+        _timeoutsCapacity *= 2;
+        Timeout **timeouts = new Timeout*[_timeoutsCapacity];
+        memcpy(timeouts, _timeouts, _timeoutsCount * sizeof(Timeout*));
+        delete[] _timeouts;
+        _timeouts = timeouts;
+    }
+
+    timeout->_heapIndex = _timeoutsCount;
+    _timeouts[_timeoutsCount++] = timeout;
+    heapUp(timeout->_heapIndex);
+
+    return timeout;
+}
+
+void XEventLoop::cancelTimeout(Timeout* timeout)
 {
-    double intpart;
-    tv->tv_usec += int(modf(sec, &intpart) * 1000000);
-    tv->tv_sec += (time_t)intpart;
-    if (tv->tv_usec > 1000000)
-        tv->tv_sec++;
+    // Timeout which is being fired right now is not in the heap and will
+    // be deleted after its callback returns
+    if (timeout->_heapIndex < 0)
+        return;
+
+    heapRemove(timeout->_heapIndex);
+    delete timeout;
 }
 
 
-Timeout* XEventLoop::addTimeout(float sec, TimeoutCallback callback)
+void XEventLoop::fireTimeouts()
 {
-    struct timeval tv;
-    gettimeofday(&tv, 0);
-    addToTimeval(sec, &tv);
+    if (_timeoutsCount == 0)
+        return;
 
-    Timeout* timeout = new Timeout(tv, callback);
+    double now = currentTime();
 
-    LinkedList<Timeout*>::Iter i = _timeouts.head();
-    int n = 0;
-    while (i)
+    while (_timeoutsCount > 0 && _timeouts[0]->_absTime <= now)
     {
-        if (timercmp((*i)->absTime(), &tv, >))
+        // Removing it first because callback may add new timeouts
+        Timeout *timeout = _timeouts[0];
+        heapRemove(0);
+
+        timeout->callback()(timeout);
+        delete timeout;
+    }
+}
+
+
+void XEventLoop::armTimer()
+{
+    if (_timerFd < 0)
+        return;
+
+    double absTime = _timeoutsCount > 0 ? _timeouts[0]->_absTime : 0;
+    if (absTime == _timerArmedTime)
+        return;
+
+    // Zero it_value disarms the timer
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (absTime > 0)
+    {
+        spec.it_value.tv_sec = (time_t)absTime;
+        spec.it_value.tv_nsec = (long)((absTime - spec.it_value.tv_sec) * 1e9);
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &spec, 0) < 0)
+        perror("timerfd_settime");
+
+    _timerArmedTime = absTime;
+}
+
+
+void XEventLoop::heapSwap(int i, int j)
+{
+    Timeout *t = _timeouts[i];
+    _timeouts[i] = _timeouts[j];
+    _timeouts[j] = t;
+
+    _timeouts[i]->_heapIndex = i;
+    _timeouts[j]->_heapIndex = j;
+}
+
+void XEventLoop::heapUp(int index)
+{
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+        if (_timeouts[parent]->_absTime <= _timeouts[index]->_absTime)
             break;
 
-        i++; n++;
+        heapSwap(index, parent);
+        index = parent;
     }
+}
 
-    _timeouts.insert(n, timeout);
+void XEventLoop::heapDown(int index)
+{
+    while (true)
+    {
+        int smallest = index;
+        int left = 2*index + 1;
+        int right = left + 1;
 
-    return timeout;
+        if (left < _timeoutsCount && _timeouts[left]->_absTime < _timeouts[smallest]->_absTime)
+            smallest = left;
+        if (right < _timeoutsCount && _timeouts[right]->_absTime < _timeouts[smallest]->_absTime)
+            smallest = right;
+
+        if (smallest == index)
+            break;
+
+        heapSwap(index, smallest);
+        index = smallest;
+    }
 }
 
-void XEventLoop::cancelTimeout(Timeout* timeout)
+void XEventLoop::heapRemove(int index)
 {
-    _timeouts.removeByValue(timeout);
+    assert(index >= 0 && index < _timeoutsCount);
+
+    _timeouts[index]->_heapIndex = -1;
+
+    _timeoutsCount--;
+    if (index == _timeoutsCount)
+        return;
+
+    _timeouts[index] = _timeouts[_timeoutsCount];
+    _timeouts[index]->_heapIndex = index;
+
+    heapUp(index);
+    heapDown(index);
+}
+
+
+double XEventLoop::currentTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 
 
 Timeout::Timeout()
-    :_callback(0)
+    :_absTime(0), _callback(0), _heapIndex(-1)
 {
-    _absTime.tv_sec = 0;
-    _absTime.tv_usec= 0;
 }
 
-Timeout::Timeout(struct timeval absTime, TimeoutCallback callback)
-    :_absTime(absTime), _callback(callback)
+Timeout::Timeout(double absTime, TimeoutCallback callback)
+    :_absTime(absTime), _callback(callback), _heapIndex(-1)
 {
 }
 
@@ -194,7 +381,7 @@ void XEventLoop::addDBusConnection(DBusConnection *dbus)
     dbus_connection_set_watch_functions(dbus,
         dbusAddWatch,
         dbusRemoveWatch,
-        0,
+        dbusWatchToggled,
         this,
         0
     );
@@ -202,13 +389,162 @@ void XEventLoop::addDBusConnection(DBusConnection *dbus)
 
 
 
+void XEventLoop::updateWatchedFd(WatchedFd *watchedFd)
+{
+    unsigned int events = 0;
+    for (Vector<DBusWatch*>::Iter i = watchedFd->watches.head(); i; ++i)
+        if (dbus_watch_get_enabled(*i))
+        {
+            unsigned int flags = dbus_watch_get_flags(*i);
+            if (flags & DBUS_WATCH_READABLE)
+                events |= EPOLLIN;
+            if (flags & DBUS_WATCH_WRITABLE)
+                events |= EPOLLOUT;
+        }
+
+    if (events == watchedFd->events)
+        return;
+
+    // Descriptor without enabled watches is removed from epoll
+    // completely, otherwise we would be woken up by EPOLLHUP forever
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = watchedFd;
+
+    int op;
+    if (watchedFd->events == 0)
+        op = EPOLL_CTL_ADD;
+    else if (events == 0)
+        op = EPOLL_CTL_DEL;
+    else
+        op = EPOLL_CTL_MOD;
+
+    if (epoll_ctl(_epollFd, op, watchedFd->fd, &ev) < 0)
+        perror("epoll_ctl(D-Bus watch)");
+
+    watchedFd->events = events;
+}
+
+
+void XEventLoop::handleWatchedFd(WatchedFd *watchedFd, unsigned int events)
+{
+    unsigned int flags = 0;
+    if (events & EPOLLIN)
+        flags |= DBUS_WATCH_READABLE;
+    if (events & EPOLLOUT)
+        flags |= DBUS_WATCH_WRITABLE;
+    if (events & EPOLLERR)
+        flags |= DBUS_WATCH_ERROR;
+    if (events & EPOLLHUP)
+        flags |= DBUS_WATCH_HANGUP;
+
+    // Handling a watch can add or remove watches, so walking a copy and
+    // skipping ones removed meanwhile
+    Vector<DBusWatch*> watches = watchedFd->watches;
+    for (Vector<DBusWatch*>::Iter i = watches.head(); i; ++i)
+    {
+        if (! watchedFd->watches.contains(*i) || ! dbus_watch_get_enabled(*i))
+            continue;
+
+        unsigned int watchFlags = flags & (dbus_watch_get_flags(*i) |
+            DBUS_WATCH_ERROR | DBUS_WATCH_HANGUP);
+        if (watchFlags)
+            dbus_watch_handle(*i, watchFlags);
+    }
+}
+
+
+
 dbus_bool_t XEventLoop::dbusAddWatch(DBusWatch *watch, void *data)
 {
-    static_cast<XEventLoop*>(data)->_dbusWatches.append(watch);
+    XEventLoop *self = static_cast<XEventLoop*>(data);
+    int fd = dbus_watch_get_unix_fd(watch);
+
+    WatchedFd *watchedFd = 0;
+    for (Vector<WatchedFd*>::Iter i = self->_watchedFds.head(); i; ++i)
+        if ((*i)->fd == fd)
+        {
+            watchedFd = *i;
+            break;
+        }
+
+    if (! watchedFd)
+    {
+        watchedFd = new WatchedFd;
+        watchedFd->fd = fd;
+        watchedFd->events = 0;
+        self->_watchedFds.append(watchedFd);
+    }
+
+    watchedFd->watches.append(watch);
+    dbus_watch_set_data(watch, watchedFd, 0);
+
+    self->updateWatchedFd(watchedFd);
     return true;
 }
 
 void XEventLoop::dbusRemoveWatch(DBusWatch *watch, void *data)
 {
-    static_cast<XEventLoop*>(data)->_dbusWatches.removeByValue(watch);
+    XEventLoop *self = static_cast<XEventLoop*>(data);
+    WatchedFd *watchedFd = static_cast<WatchedFd*>(dbus_watch_get_data(watch));
+    if (! watchedFd)
+        return;
+
+    dbus_watch_set_data(watch, 0, 0);
+    watchedFd->watches.removeByValue(watch);
+    self->updateWatchedFd(watchedFd);
+
+    if (watchedFd->watches.size() == 0)
+    {
+        self->_watchedFds.removeByValue(watchedFd);
+        self->_deadWatchedFds.append(watchedFd);
+    }
+}
+
+void XEventLoop::dbusWatchToggled(DBusWatch *watch, void *data)
+{
+    XEventLoop *self = static_cast<XEventLoop*>(data);
+    WatchedFd *watchedFd = static_cast<WatchedFd*>(dbus_watch_get_data(watch));
+    if (watchedFd)
+        self->updateWatchedFd(watchedFd);
+}
+
+
+
+void XEventLoop::addFdWatch(int fd, FdCallback callback)
+{
+    WatchedFd *watchedFd = new WatchedFd;
+    watchedFd->fd = fd;
+    watchedFd->events = EPOLLIN;
+    watchedFd->callback = callback;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = watchedFd;
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl(fd watch)");
+        delete watchedFd;
+        return;
+    }
+
+    _fdWatches.append(watchedFd);
+}
+
+void XEventLoop::removeFdWatch(int fd)
+{
+    for (Vector<WatchedFd*>::Iter i = _fdWatches.head(); i; ++i)
+        if ((*i)->fd == fd)
+        {
+            WatchedFd *watchedFd = *i;
+
+            struct epoll_event ev;  // Ignored, but old kernels need it
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, &ev);
+            _fdWatches.remove(i);
+
+            // May be removed from its own callback, pending epoll events
+            // still refer to it
+            watchedFd->callback = FdCallback();
+            _deadWatchedFds.append(watchedFd);
+        }
 }
@@ -5,7 +5,7 @@
 
 #include <dbus/dbus.h>
 
-#include "LinkedList.h"
+#include "Vector.h"
 #include "Delegate.h"
 
 class XEventHandler;
@@ -16,17 +16,26 @@ class Timeout;
 
 typedef Delegate1<Timeout*> TimeoutCallback;
 
+// Receives file descriptor that became readable
+typedef Delegate1<int> FdCallback;
+
+// Timeout objects are owned by XEventLoop. They are deleted after the
+// callback returns or when timeout is cancelled
 struct Timeout
 {
     private:
-        struct timeval _absTime;
+        friend class XEventLoop;
+
+        double _absTime;        // In XEventLoop::currentTime() units
         TimeoutCallback _callback;
 
+        int _heapIndex;         // Position in XEventLoop's heap, -1 if not there
+
     public:
         Timeout();
-        Timeout(struct timeval absTime, TimeoutCallback callback);
+        Timeout(double absTime, TimeoutCallback callback);
 
-        const struct timeval* absTime() const { return &_absTime; }
+        double absTime() const { return _absTime; }
         TimeoutCallback callback() const { return _callback; }
 };
 
@@ -39,18 +48,68 @@ class XEventLoop
 
         bool _breakEventLoop;
 
-        LinkedList<XEventHandler*> _eventHandlers;
+        Vector<XEventHandler*> _eventHandlers;
+
+        Vector<XIdleTask*> _idleTasks;
+
+        int _epollFd;
+
+
+        // Pending timeouts, binary min-heap ordered by absTime
+        Timeout **_timeouts;
+        int _timeoutsCount;
+        int _timeoutsCapacity;
+
+        void heapSwap(int i, int j);
+        void heapUp(int index);
+        void heapDown(int index);
+        void heapRemove(int index);
+
+        void fireTimeouts();
+
+
+        // timerfd armed to the nearest timeout
+        int _timerFd;
+        double _timerArmedTime;
+
+        void armTimer();
 
-        LinkedList<XIdleTask*> _idleTasks;
 
-        LinkedList<Timeout*> _timeouts;
+        // All D-Bus watches on the same file descriptor share single
+        // epoll registration. Descriptors added with addFdWatch() have
+        // callback instead of watches
+        struct WatchedFd
+        {
+            int fd;
+            unsigned int events;    // Currently registered in epoll
+            Vector<DBusWatch*> watches;
+            FdCallback callback;
+        };
 
+        Vector<WatchedFd*> _watchedFds;
+        Vector<WatchedFd*> _fdWatches;
+        Vector<WatchedFd*> _deadWatchedFds;
 
-        LinkedList<DBusWatch*> _dbusWatches;
+        // Markers for epoll_event.data.ptr of our own descriptors
+        WatchedFd _xSocketMarker;
+        WatchedFd _timerMarker;
+
+        void updateWatchedFd(WatchedFd *watchedFd);
+        void handleWatchedFd(WatchedFd *watchedFd, unsigned int events);
+
+
+        // Statistics of blocking client/server round trips
+        static unsigned int _roundTrips;
+        unsigned int _roundTripsPerSecond;
+        double _statsStartTime;
+        unsigned int _statsStartRoundTrips;
+
+        void updateRoundTripStats();
 
 
         static dbus_bool_t dbusAddWatch(DBusWatch *watch, void *data);
         static void dbusRemoveWatch(DBusWatch *watch, void *data);
+        static void dbusWatchToggled(DBusWatch *watch, void *data);
 
     public:
         static XEventLoop* instance() { return _instance; }
@@ -66,8 +125,28 @@ class XEventLoop
         Timeout* addTimeout(float sec, TimeoutCallback callback);
         void cancelTimeout(Timeout* timeout);
 
+        // Seconds from some unspecified point, not affected by clock changes
+        static double currentTime();
+
+
+        // XSync() that is accounted in round trip statistics. Use it only
+        // where waiting for server is really required
+        void sync();
+
+        // Must be called by code doing blocking requests (ones waiting
+        // for reply) so we can see how many of them we are doing
+        static void countRoundTrip() { _roundTrips++; }
+
+        static unsigned int roundTrips() { return _roundTrips; }
+        unsigned int roundTripsPerSecond() { return _roundTripsPerSecond; }
+
 
         void addDBusConnection(DBusConnection* dbus);
+
+
+        // Calls callback from the event loop whenever fd is readable
+        void addFdWatch(int fd, FdCallback callback);
+        void removeFdWatch(int fd);
 };
 
 
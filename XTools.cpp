@@ -17,8 +17,15 @@
 #include <X11/extensions/Xcomposite.h>
 #include <X11/extensions/Xrender.h>
 #include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/XShm.h>
 
-#include <Imlib2.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "XEventLoop.h"
+#include "Premultiply.h"
 
 
 Display* XTools::_dpy = 0;
@@ -29,8 +36,35 @@ int XTools::_damage_error_base = 0;
 int XTools::_xrender_event_base = 0;
 int XTools::_xrender_error_base = 0;
 
+int XTools::_xfixes_event_base = 0;
+int XTools::_xfixes_error_base = 0;
+
 XTools::ErrorHandler XTools::_prevErrorHandler;
 
+bool XTools::_haveShm = false;
+
+// Smaller images are cheaper to send over the socket than to copy them
+// to shared memory segment
+#define SHM_MIN_BYTES   (64 * 1024)
+
+// Initial size of the segment, it grows for larger images
+#define SHM_SEGMENT_BYTES   (2 * 1024 * 1024)
+
+// Segment shared with the server. Images are placed one after another and
+// the segment is reused from its start once the server has read them all
+static XShmSegmentInfo shmSegment;
+static int shmSize = 0;                 // 0 if no segment is attached
+static int shmOffset = 0;               // Free space starts here
+static unsigned long shmLastPut = 0;    // Request number of last XShmPutImage
+
+static bool shmAttachFailed;
+
+static int shmErrorHandler(Display *display, XErrorEvent *event)
+{
+    shmAttachFailed = true;
+    return 0;
+}
+
 Atom XTools::_NET_CLIENT_LIST;
 Atom XTools::_NET_WM_WINDOW_TYPE;
 Atom XTools::_NET_WM_WINDOW_TYPE_NORMAL;
@@ -44,6 +78,7 @@ Atom XTools::_NET_WM_STATE_HIDDEN;
 Atom XTools::_NET_ACTIVE_WINDOW;
 Atom XTools::_NET_SHOWING_DESKTOP;
 Atom XTools::_NET_CLOSE_WINDOW;
+Atom XTools::_NET_FRAME_EXTENTS;
 Atom XTools::WM_STATE;
 Atom XTools::WM_NAME;
 Atom XTools::_NET_WM_ICON;
@@ -70,6 +105,7 @@ void XTools::init(Display *dpy)
     INIT_ATOM(dpy, _NET_ACTIVE_WINDOW);
     INIT_ATOM(dpy, _NET_SHOWING_DESKTOP);
     INIT_ATOM(dpy, _NET_CLOSE_WINDOW);
+    INIT_ATOM(dpy, _NET_FRAME_EXTENTS);
     INIT_ATOM(dpy, WM_STATE);
     INIT_ATOM(dpy, WM_NAME);
     INIT_ATOM(dpy, _NET_WM_ICON);
@@ -77,6 +113,12 @@ void XTools::init(Display *dpy)
     INIT_ATOM(dpy, WM_DELETE_WINDOW);
 
     _prevErrorHandler = XSetErrorHandler(errorHandler);
+
+    // Shared memory works only with local server, and only if it can see
+    // our segments, which is not the case in another IPC namespace
+    const char *displayName = DisplayString(dpy);
+    bool local = displayName[0] == ':' || strncmp(displayName, "unix:", 5) == 0;
+    _haveShm = local && XShmQueryExtension(dpy) && attachShm(SHM_SEGMENT_BYTES);
 }
 
 Window XTools::rootWindow()
@@ -84,66 +126,61 @@ Window XTools::rootWindow()
     return RootWindow(_dpy, DefaultScreen(_dpy));
 }
 
-LinkedList<Window> XTools::windowList(Window rootWindow, bool includeDesktop)
+Vector<Window> XTools::clientList(Window rootWindow)
 {
-    LinkedList<Window> list;
+    Vector<Window> list;
 
     Atom real_type;
     int real_format;
     unsigned long items_read, items_left;
-    Window *windows;
+    Window *windows = 0;
+    XEventLoop::countRoundTrip();
     if (XGetWindowProperty(_dpy, rootWindow, _NET_CLIENT_LIST, 0L, 8192L, False,
         XA_WINDOW, &real_type, &real_format, &items_read, &items_left, (unsigned char**)&windows)
         != Success)
     {
         return list;
     }
-    else
+
+    if (windows)
     {
         for (unsigned int i = 0; i < items_read; i++)
-        {
-            unsigned long items_read, items_left;
-            Atom real_type;
-            int real_format;
-            Atom *windowType;
-
-            if (XGetWindowProperty(_dpy, windows[i], _NET_WM_WINDOW_TYPE, 0L, 1L, False,
-                XA_ATOM, &real_type, &real_format, &items_read, &items_left,
-                (unsigned char**)&windowType) != Success)
-            {
-                continue;
-            }
-            else
-            {
-                //bool ok = (items_read > 0 && *windowType == _NET_WM_WINDOW_TYPE_NORMAL);
-                bool ok = true;
-                if (items_read > 0 && *windowType != _NET_WM_WINDOW_TYPE_NORMAL)
-                {
-                    if ((! includeDesktop) || *windowType != _NET_WM_WINDOW_TYPE_DESKTOP)
-                        ok = false;
-                }
-
-                XFree((unsigned char*)windowType);
-
-                if (! ok)
-                {
-                    continue;
-                }
-            }
-
             list.append(windows[i]);
-        }
 
         XFree((unsigned char*)windows);
-
-        return list;
     }
+
+    return list;
+}
+
+
+bool XTools::isSwitchableWindowType(Atom type, bool includeDesktop)
+{
+    // Windows without _NET_WM_WINDOW_TYPE are treated as normal ones
+    if (type == None || type == _NET_WM_WINDOW_TYPE_NORMAL)
+        return true;
+
+    return includeDesktop && type == _NET_WM_WINDOW_TYPE_DESKTOP;
+}
+
+
+Vector<Window> XTools::windowList(Window rootWindow, bool includeDesktop)
+{
+    Vector<Window> list;
+
+    Vector<Window> clients = clientList(rootWindow);
+    for (Vector<Window>::Iter i = clients.head(); i; ++i)
+        if (isSwitchableWindowType(windowType(*i), includeDesktop))
+            list.append(*i);
+
+    return list;
 }
 
 
 char* XTools::windowTitle_alloc(Window window)
 {
     XTextProperty wmName;
+    XEventLoop::countRoundTrip();
     XGetTextProperty(_dpy, window, &wmName, _NET_WM_NAME);
     if (wmName.value)
     {
@@ -153,6 +190,7 @@ char* XTools::windowTitle_alloc(Window window)
     }
     else
     {
+        XEventLoop::countRoundTrip();
         XGetTextProperty(_dpy, window, &wmName, WM_NAME);
         if (wmName.value)
         {
@@ -169,6 +207,7 @@ char* XTools::windowClass_alloc(Window window)
 {
     XClassHint classHint;
 
+    XEventLoop::countRoundTrip();
     if (XGetClassHint(_dpy, window, &classHint) != 0)
     {
         char *ret = strdup(classHint.res_name);
@@ -182,6 +221,168 @@ char* XTools::windowClass_alloc(Window window)
 
 
 
+// Copies string property value, returns 0 if there is no value
+static char* propertyString_alloc(xcb_get_property_reply_t *reply)
+{
+    if (reply == 0 || reply->format != 8)
+        return 0;
+
+    int length = xcb_get_property_value_length(reply);
+    if (length <= 0)
+        return 0;
+
+    char *ret = (char*)malloc(length + 1);
+    memcpy(ret, xcb_get_property_value(reply), length);
+    ret[length] = '\0';
+    return ret;
+}
+
+// Returns first 32-bit item of property value or \c def
+static unsigned int propertyCard32(xcb_get_property_reply_t *reply, unsigned int def)
+{
+    if (reply == 0 || reply->format != 32 || xcb_get_property_value_length(reply) < 4)
+        return def;
+
+    return *(unsigned int*)xcb_get_property_value(reply);
+}
+
+// Reply collection helpers: errors are not interesting here, missing
+// windows and properties are reported by null reply
+static xcb_get_property_reply_t* propertyReply(xcb_connection_t *conn, xcb_get_property_cookie_t cookie)
+{
+    xcb_generic_error_t *error = 0;
+    xcb_get_property_reply_t *reply = xcb_get_property_reply(conn, cookie, &error);
+    free(error);
+    return reply;
+}
+
+static xcb_get_geometry_reply_t* geometryReply(xcb_connection_t *conn, xcb_get_geometry_cookie_t cookie)
+{
+    xcb_generic_error_t *error = 0;
+    xcb_get_geometry_reply_t *reply = xcb_get_geometry_reply(conn, cookie, &error);
+    free(error);
+    return reply;
+}
+
+
+void XTools::fetchWindowInfo(WindowInfo *infos, int count)
+{
+    if (count <= 0)
+        return;
+
+    xcb_connection_t *conn = XGetXCBConnection(_dpy);
+
+    struct Cookies
+    {
+        xcb_get_property_cookie_t netWmName;
+        xcb_get_property_cookie_t wmName;
+        xcb_get_property_cookie_t wmClass;
+        xcb_get_property_cookie_t wmState;
+        xcb_get_property_cookie_t windowType;
+        xcb_get_property_cookie_t frameExtents;
+        xcb_get_geometry_cookie_t geometry;
+        xcb_translate_coordinates_cookie_t position;
+    };
+
+    Cookies *cookies = new Cookies[count];
+
+    xcb_window_t root = DefaultRootWindow(_dpy);
+
+    // Xlib may have buffered requests this batch depends on
+    XFlush(_dpy);
+
+    for (int i = 0; i < count; ++i)
+    {
+        xcb_window_t w = infos[i].window;
+        Cookies &c = cookies[i];
+
+        c.netWmName  = xcb_get_property(conn, 0, w, _NET_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, 1024);
+        c.wmName     = xcb_get_property(conn, 0, w, WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, 1024);
+        c.wmClass    = xcb_get_property(conn, 0, w, XA_WM_CLASS, XA_STRING, 0, 1024);
+        c.wmState    = xcb_get_property(conn, 0, w, WM_STATE, WM_STATE, 0, 1);
+        c.windowType = xcb_get_property(conn, 0, w, _NET_WM_WINDOW_TYPE, XA_ATOM, 0, 1);
+        c.frameExtents = xcb_get_property(conn, 0, w, _NET_FRAME_EXTENTS, XA_CARDINAL, 0, 4);
+        c.geometry   = xcb_get_geometry(conn, w);
+        c.position   = xcb_translate_coordinates(conn, w, root, 0, 0);
+    }
+
+
+    XEventLoop::countRoundTrip();
+
+    for (int i = 0; i < count; ++i)
+    {
+        WindowInfo &info = infos[i];
+        Cookies &c = cookies[i];
+
+        xcb_get_property_reply_t *netWmName  = propertyReply(conn, c.netWmName);
+        xcb_get_property_reply_t *wmName     = propertyReply(conn, c.wmName);
+        xcb_get_property_reply_t *wmClass    = propertyReply(conn, c.wmClass);
+        xcb_get_property_reply_t *wmState    = propertyReply(conn, c.wmState);
+        xcb_get_property_reply_t *windowType = propertyReply(conn, c.windowType);
+        xcb_get_property_reply_t *frameExtents = propertyReply(conn, c.frameExtents);
+        xcb_get_geometry_reply_t *geometry   = geometryReply(conn, c.geometry);
+
+        xcb_generic_error_t *error = 0;
+        xcb_translate_coordinates_reply_t *position = xcb_translate_coordinates_reply(conn, c.position, &error);
+        free(error);
+
+        info.valid = geometry != 0 && position != 0;
+
+        info.title = propertyString_alloc(netWmName);
+        if (info.title == 0)
+            info.title = propertyString_alloc(wmName);
+        if (info.title == 0)
+            info.title = strdup("");
+
+        // WM_CLASS is "res_name\0res_class\0", we need res_name only
+        info.clientClass = propertyString_alloc(wmClass);
+        if (info.clientClass == 0)
+            info.clientClass = strdup("");
+
+        info.type = propertyCard32(windowType, None);
+        info.minimized = propertyCard32(wmState, WithdrawnState) == IconicState;
+
+        info.x = geometry ? geometry->x : 0;
+        info.y = geometry ? geometry->y : 0;
+        info.width = geometry ? geometry->width : 1;
+        info.height = geometry ? geometry->height : 1;
+
+        info.decoX = info.x;
+        info.decoY = info.y;
+
+#ifdef DESKTOP
+        if (position)
+        {
+            // Decoration starts _NET_FRAME_EXTENTS (left, right, top,
+            // bottom) before the client. Without them the client is taken
+            // to be directly in the decoration window
+            int left = info.x, top = info.y;
+            if (frameExtents && frameExtents->format == 32 &&
+                xcb_get_property_value_length(frameExtents) >= 16)
+            {
+                const unsigned int *extents = (const unsigned int*)xcb_get_property_value(frameExtents);
+                left = extents[0];
+                top = extents[2];
+            }
+
+            info.decoX = position->dst_x - left;
+            info.decoY = position->dst_y - top;
+        }
+#endif
+
+        free(netWmName);
+        free(wmName);
+        free(wmClass);
+        free(wmState);
+        free(windowType);
+        free(frameExtents);
+        free(geometry);
+        free(position);
+    }
+
+    delete[] cookies;
+}
+
 bool XTools::checkCompositeExtension()
 {
     int event_base, error_base;
@@ -209,6 +410,21 @@ bool XTools::checkDamageExtension()
 }
 
 
+bool XTools::checkXFixesExtension()
+{
+    if (! XFixesQueryExtension(_dpy, &_xfixes_event_base, &_xfixes_error_base))
+        return false;
+
+    // Server regions need XFixes 2.0, and the version must be
+    // announced before any XFixes request is sent
+    int major = 2, minor = 0;
+    if (! XFixesQueryVersion(_dpy, &major, &minor))
+        return false;
+
+    return major >= 2;
+}
+
+
 bool XTools::checkXRenderExtension()
 {
     if (! XRenderQueryExtension(_dpy, &_xrender_event_base, &_xrender_error_base))
@@ -315,8 +531,8 @@ void XTools::showDesktop(bool iconifyAll)
     {
         // Bad and ugly way -- minimizing all windows
 
-        LinkedList<Window> windows = windowList(RootWindow(_dpy, DefaultScreen(_dpy)));
-        for (LinkedList<Window>::Iter i = windows.head(); i; ++i)
+        Vector<Window> windows = windowList(RootWindow(_dpy, DefaultScreen(_dpy)));
+        for (Vector<Window>::Iter i = windows.head(); i; ++i)
             if (! checkIfWindowMinimized(*i))
                 minimize(*i);
     }
@@ -332,6 +548,7 @@ bool XTools::checkIfWindowMinimized(Window window)
     Atom actual_type;
     int actual_format;
 
+    XEventLoop::countRoundTrip();
     int status = XGetWindowProperty(_dpy, window, WM_STATE,
         0, 1,
         False, WM_STATE,
@@ -360,6 +577,7 @@ Window XTools::activeWindow()
 
     Window *property;
 
+    XEventLoop::countRoundTrip();
     int status = XGetWindowProperty(_dpy, DefaultRootWindow(_dpy), _NET_ACTIVE_WINDOW,
         0, 1,
         False, XA_WINDOW,
@@ -386,8 +604,9 @@ Atom XTools::windowType(Window window)
     Atom actual_type;
     int actual_format;
 
-    Atom *property;
+    Atom *property = 0;
 
+    XEventLoop::countRoundTrip();
     int status = XGetWindowProperty(_dpy, window, _NET_WM_WINDOW_TYPE,
         0, 1,
         False, XA_ATOM,
@@ -396,10 +615,11 @@ Atom XTools::windowType(Window window)
         (unsigned char**)&property
     );
 
-    if (status != Success)
-        return 0;
+    if (status != Success || property == 0)
+        return None;
 
-    Atom result = *property;
+    // Property may be absent, then nothing is returned
+    Atom result = nitems > 0 ? *property : None;
 
     XFree(property);
 
@@ -438,6 +658,7 @@ const XVisualInfo* XTools::rgbaVisual()
         int scr = DefaultScreen(_dpy);
         if (XMatchVisualInfo(_dpy, scr, 32, TrueColor, &rgbaVisual) == 0)
             fprintf(stderr, "Cannot find rgba visual\n");
+        inited = true;
     }
 
     return &rgbaVisual;
@@ -458,6 +679,130 @@ XRenderPictFormat* XTools::xrenderRGBAFormat()
 
 
 
+Pixmap XTools::createARGBPixmap(const unsigned int *pixels, int width, int height)
+{
+    Pixmap pixmap = XCreatePixmap(_dpy, rootWindow(), width, height, 32);
+    GC gc = XCreateGC(_dpy, pixmap, 0, 0);
+
+    if (! _haveShm || width * height * 4 < SHM_MIN_BYTES ||
+        ! putImageShm(pixmap, gc, pixels, width, height))
+    {
+        XImage *ximage = XCreateImage(_dpy, rgbaVisual()->visual, 32, ZPixmap, 0,
+            (char*)pixels, width, height, 32, width * 4);
+
+        // Pixels are in client byte order, Xlib swaps them if needed
+        int one = 1;
+        ximage->byte_order = *(char*)&one ? LSBFirst : MSBFirst;
+
+        XPutImage(_dpy, pixmap, gc, ximage, 0, 0, 0, 0, width, height);
+
+        // Data is not ours
+        ximage->data = 0;
+        XDestroyImage(ximage);
+    }
+
+    XFreeGC(_dpy, gc);
+
+    return pixmap;
+}
+
+
+bool XTools::attachShm(int size)
+{
+    shmSegment.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shmSegment.shmid < 0)
+        return false;
+
+    shmSegment.shmaddr = (char*)shmat(shmSegment.shmid, 0, 0);
+    shmSegment.readOnly = True;
+    if (shmSegment.shmaddr == (char*)-1)
+    {
+        shmctl(shmSegment.shmid, IPC_RMID, 0);
+        return false;
+    }
+
+    // XShmAttach() returns True even if the server cannot attach the
+    // segment, the error comes later. Waiting for it here
+    shmAttachFailed = false;
+    ErrorHandler handler = XSetErrorHandler(shmErrorHandler);
+    XShmAttach(_dpy, &shmSegment);
+    XEventLoop::countRoundTrip();
+    XSync(_dpy, False);
+    XSetErrorHandler(handler);
+
+    // Segment goes away when both we and the server detach
+    shmctl(shmSegment.shmid, IPC_RMID, 0);
+
+    if (shmAttachFailed)
+    {
+        fprintf(stderr, "MIT-SHM segment cannot be attached, not using it\n");
+        shmdt(shmSegment.shmaddr);
+        return false;
+    }
+
+    shmSize = size;
+    shmOffset = 0;
+    return true;
+}
+
+void XTools::detachShm()
+{
+    if (shmSize == 0)
+        return;
+
+    // Server keeps its own mapping until it processes the detach, so
+    // images put before it are still read correctly
+    XShmDetach(_dpy, &shmSegment);
+    shmdt(shmSegment.shmaddr);
+    shmSize = 0;
+}
+
+bool XTools::putImageShm(Drawable drawable, GC gc, const unsigned int *pixels, int width, int height)
+{
+    int bytes = width * height * 4;
+
+    if (shmOffset + bytes > shmSize)
+    {
+        if (bytes > shmSize)
+        {
+            detachShm();
+            if (! attachShm(bytes > SHM_SEGMENT_BYTES ? bytes : SHM_SEGMENT_BYTES))
+            {
+                _haveShm = false;
+                return false;
+            }
+        }
+        else if (LastKnownRequestProcessed(_dpy) < shmLastPut)
+        {
+            // Server may still be reading images at the start
+            XEventLoop::countRoundTrip();
+            XSync(_dpy, False);
+        }
+
+        shmOffset = 0;
+    }
+
+    XImage *ximage = XShmCreateImage(_dpy, rgbaVisual()->visual, 32, ZPixmap, 0,
+        &shmSegment, width, height);
+    if (ximage == 0)
+        return false;
+
+    // Offset in the segment is sent as difference of these pointers
+    ximage->data = shmSegment.shmaddr + shmOffset;
+    for (int y = 0; y < height; ++y)
+        memcpy(ximage->data + y * ximage->bytes_per_line, pixels + y * width, width * 4);
+
+    shmLastPut = NextRequest(_dpy);
+    XShmPutImage(_dpy, drawable, gc, ximage, 0, 0, 0, 0, width, height, False);
+    shmOffset += ximage->bytes_per_line * height;
+
+    ximage->data = 0;
+    XDestroyImage(ximage);
+
+    return true;
+}
+
+
 bool XTools::fetchWindowIconFromProperty(
         Window window,
         int *width, int *height,
@@ -476,46 +821,43 @@ bool XTools::fetchWindowIconFromProperty(
 
     unsigned int *iconData;
 
+    XEventLoop::countRoundTrip();
     if (XGetWindowProperty(_dpy, window, _NET_WM_ICON, 0, 8192L, False,
             XA_CARDINAL, &real_type, &real_format, &items_read, &items_left,
             (unsigned char **)&iconData) == Success && items_read > 0)
     {
-        int w = iconData[0];
-        int h = iconData[1];
+        unsigned long *items = (unsigned long*)iconData;
+
+        // Width and height come first, any client can set shorter property
+        if (items_read < 2)
+        {
+            XFree((unsigned char*)iconData);
+            return false;
+        }
+
+        int w = items[0];
+        int h = items[1];
+
+        if (w <= 0 || h <= 0 || items_read - 2 < (unsigned long)w * h)
+        {
+            XFree((unsigned char*)iconData);
+            return false;
+        }
 
         if (width) *width = w;
         if (height) *height = h;
 
         if (pixmap)
         {
-            Imlib_Image icon = imlib_create_image_using_data( w, h, &iconData[2]);
-            imlib_context_set_image(icon);
-            imlib_image_set_has_alpha(1);
-
-            *pixmap = XCreatePixmap(_dpy, RootWindow(_dpy, DefaultScreen(_dpy)), w, h, 32);
-
-            imlib_context_set_display(_dpy);
-            imlib_context_set_visual(rgbaVisual()->visual);
-            imlib_context_set_colormap(DefaultColormap(_dpy, DefaultScreen(_dpy)));
-            imlib_context_set_drawable(*pixmap);
-
-            // Making image with premultiplied alpha
-            Imlib_Image premul = imlib_create_image(w, h);
-            imlib_context_set_image(premul);
-            imlib_image_set_has_alpha(1);
-            imlib_context_set_color(0, 0, 0, 255);
-            imlib_context_set_blend(0);
-            imlib_image_fill_rectangle(0, 0, w, h);
-            imlib_context_set_blend(1);
-            imlib_blend_image_onto_image(icon, 0, 0, 0, w, h, 0, 0, w, h);
-            imlib_image_copy_alpha_to_image(icon, 0, 0);
-
-            imlib_context_set_blend(0);
-            imlib_render_image_on_drawable(0, 0);
-
-            imlib_free_image();
-            imlib_context_set_image(icon);
-            imlib_free_image();
+            // Property items are longs, which may be wider than pixels
+            unsigned int *pixels = new unsigned int[w * h];
+            for (int i = 0; i < w * h; ++i)
+                pixels[i] = items[2 + i];
+
+            Premultiply::premultiply(pixels, w * h);
+            *pixmap = createARGBPixmap(pixels, w, h);
+
+            delete[] pixels;
 
             if (picture)
             {
@@ -15,7 +15,27 @@
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrender.h>
 
-#include "LinkedList.h"
+#include "Vector.h"
+
+
+// Everything thumbnail needs to know about client window. Filled by
+// XTools::fetchWindowInfo()
+struct WindowInfo
+{
+    Window window;
+
+    bool valid;         // false if window has gone before replies arrived
+
+    Atom type;          // _NET_WM_WINDOW_TYPE or None
+    char *title;        // malloc'ed, receiver may take it and set to 0
+    char *clientClass;  // malloc'ed, receiver may take it and set to 0
+    bool minimized;
+
+    int x, y;           // Position in parent window
+    int width, height;
+    int decoX, decoY;   // Position of WM decoration window
+};
+
 
 class XTools
 {
@@ -28,9 +48,17 @@ class XTools
         static int _xrender_event_base;
         static int _xrender_error_base;
 
+        static int _xfixes_event_base;
+        static int _xfixes_error_base;
+
         typedef int (*ErrorHandler)(Display *display, XErrorEvent *event);
         static ErrorHandler _prevErrorHandler;
 
+        static bool _haveShm;
+        static bool attachShm(int size);
+        static void detachShm();
+        static bool putImageShm(Drawable drawable, GC gc, const unsigned int *pixels, int width, int height);
+
     public:
         static Atom _NET_CLIENT_LIST;
         static Atom _NET_WM_WINDOW_TYPE;
@@ -45,6 +73,7 @@ class XTools
         static Atom _NET_ACTIVE_WINDOW;
         static Atom _NET_SHOWING_DESKTOP;
         static Atom _NET_CLOSE_WINDOW;
+        static Atom _NET_FRAME_EXTENTS;
         static Atom WM_STATE;
         static Atom WM_NAME;
         static Atom _NET_WM_ICON;
@@ -55,14 +84,29 @@ class XTools
 
         static Window rootWindow();
 
-        static LinkedList<Window> windowList(Window rootWindow, bool includeDesktop = false);
+        // Raw contents of _NET_CLIENT_LIST
+        static Vector<Window> clientList(Window rootWindow);
+        // Client list filtered with isSwitchableWindowType(). Costs one
+        // round trip for the list and one more per client for its
+        // _NET_WM_WINDOW_TYPE, use fetchWindowInfo() for many windows
+        static Vector<Window> windowList(Window rootWindow, bool includeDesktop = false);
+
+        // Whether window with given _NET_WM_WINDOW_TYPE gets a thumbnail
+        static bool isSwitchableWindowType(Atom type, bool includeDesktop);
 
         static char* windowTitle_alloc(Window window);
         static char* windowClass_alloc(Window window);
 
+        // Fetches info for many windows at once: all requests are sent
+        // before waiting for any reply, so whole batch costs one round
+        // trip regardless of its size. Caller sets infos[i].window and
+        // must free() title and clientClass afterwards
+        static void fetchWindowInfo(WindowInfo *infos, int count);
+
         static bool checkXRenderExtension();
         static bool checkCompositeExtension();
         static bool checkDamageExtension();
+        static bool checkXFixesExtension();
 
 
         static void enableCompositeRedirect();
@@ -91,6 +135,10 @@ class XTools
         static XRenderPictFormat* xrenderRGBAFormat();
         static const XVisualInfo* rgbaVisual();
 
+        // Uploads premultiplied native-endian ARGB32 pixels to new
+        // 32-bit pixmap. Large images go through MIT-SHM, if possible.
+        static Pixmap createARGBPixmap(const unsigned int *pixels, int width, int height);
+
         static bool fetchWindowIconFromProperty(
             Window window,
             int *width, int *height,
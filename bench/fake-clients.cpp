@@ -0,0 +1,119 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+// fake-clients - synthetic client windows for benchmarking
+//
+// Usage: fake-clients <count> [<damage rate>]
+//
+// Creates <count> mapped top-level windows and publishes them in
+// _NET_CLIENT_LIST the way a window manager would, so telescope can run
+// on bare Xvfb. With non-zero damage rate, one window per tick is
+// repainted to keep Damage events flowing. Runs until killed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <count> [<damage rate>]\n", argv[0]);
+        return 1;
+    }
+
+    int count = atoi(argv[1]);
+    int damageRate = argc > 2 ? atoi(argv[2]) : 0;
+
+    if (count < 1)
+        count = 1;
+
+    Display *dpy = XOpenDisplay(0);
+    if (! dpy)
+    {
+        fprintf(stderr, "Cannot open display\n");
+        return 1;
+    }
+
+    int screen = DefaultScreen(dpy);
+    Window root = RootWindow(dpy, screen);
+
+    Atom _NET_CLIENT_LIST = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+    Atom _NET_ACTIVE_WINDOW = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
+    Atom _NET_WM_NAME = XInternAtom(dpy, "_NET_WM_NAME", False);
+    Atom UTF8_STRING = XInternAtom(dpy, "UTF8_STRING", False);
+
+    int rootWidth = DisplayWidth(dpy, screen);
+    int rootHeight = DisplayHeight(dpy, screen);
+
+    Window *windows = new Window[count];
+    GC *gcs = new GC[count];
+
+    for (int i = 0; i < count; ++i)
+    {
+        int width = 200 + (i * 37) % 400;
+        int height = 150 + (i * 53) % 300;
+        int x = (i * 41) % (rootWidth - width > 0 ? rootWidth - width : 1);
+        int y = (i * 29) % (rootHeight - height > 0 ? rootHeight - height : 1);
+
+        unsigned long color = ((i * 0x3f) & 0xff) << 16 | ((i * 0x95) & 0xff) << 8 | ((i * 0x1d) & 0xff);
+
+        windows[i] = XCreateSimpleWindow(dpy, root, x, y, width, height, 0, 0, color);
+
+        char title[64];
+        snprintf(title, sizeof(title), "Fake client %d", i);
+        XStoreName(dpy, windows[i], title);
+        XChangeProperty(dpy, windows[i], _NET_WM_NAME, UTF8_STRING, 8,
+            PropModeReplace, (unsigned char*)title, strlen(title));
+
+        XClassHint classHint;
+        classHint.res_name = (char*)"fake-client";
+        classHint.res_class = (char*)"FakeClient";
+        XSetClassHint(dpy, windows[i], &classHint);
+
+        gcs[i] = XCreateGC(dpy, windows[i], 0, 0);
+
+        XMapWindow(dpy, windows[i]);
+    }
+
+    XChangeProperty(dpy, root, _NET_CLIENT_LIST, XA_WINDOW, 32,
+        PropModeReplace, (unsigned char*)windows, count);
+    XChangeProperty(dpy, root, _NET_ACTIVE_WINDOW, XA_WINDOW, 32,
+        PropModeReplace, (unsigned char*)&windows[0], 1);
+
+    XSync(dpy, False);
+
+
+    int tick = 0;
+    while (true)
+    {
+        if (damageRate <= 0)
+        {
+            pause();
+            continue;
+        }
+
+        usleep(1000000 / damageRate);
+
+        int i = tick % count;
+        XSetForeground(dpy, gcs[i], (tick * 0x10101) & 0xffffff);
+        XFillRectangle(dpy, windows[i], gcs[i], (tick * 7) % 100, (tick * 11) % 100, 50, 50);
+        XFlush(dpy);
+
+        tick++;
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+# Telescope - graphical task switcher
+#
+# $Id$
+#
+# Reads TELESCOPE_TRACE log and prints distribution of intervals between
+# beginning of "show" and the first "synced" event after it, in ms.
+
+$2 == "B" && $3 == "show" {
+    start = $1
+    waiting = 1
+}
+
+$2 == "I" && $3 == "synced" && waiting {
+    samples[n++] = ($1 - start) * 1000
+    waiting = 0
+}
+
+function percentile(p,    i) {
+    i = int(p * (n - 1) + 0.5)
+    return samples[i]
+}
+
+END {
+    if (n == 0) {
+        print "no samples"
+        exit 1
+    }
+
+    # Insertion sort, sample counts are small
+    for (i = 1; i < n; i++) {
+        v = samples[i]
+        for (j = i - 1; j >= 0 && samples[j] > v; j--)
+            samples[j + 1] = samples[j]
+        samples[j + 1] = v
+    }
+
+    sum = 0
+    for (i = 0; i < n; i++)
+        sum += samples[i]
+
+    printf "samples=%d min=%.2f median=%.2f p90=%.2f p99=%.2f max=%.2f mean=%.2f (ms)\n",
+        n, samples[0], percentile(0.5), percentile(0.9), percentile(0.99),
+        samples[n - 1], sum / n
+}
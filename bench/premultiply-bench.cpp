@@ -0,0 +1,124 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+// premultiply-bench - compares alpha premultiplication kernels
+//
+// Usage: premultiply-bench [<width> [<height> [<iterations>]]]
+//
+// Runs every Premultiply variant supported by the CPU and the imlib2
+// blend-onto-black sequence Image used before, over the same random
+// image, and prints time per megapixel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <Imlib2.h>
+
+#include "Premultiply.h"
+
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// The way Image and XTools premultiplied pixels with imlib2
+static void imlibPremultiply(unsigned int *pixels, int width, int height)
+{
+    Imlib_Image image = imlib_create_image_using_data(width, height, pixels);
+    imlib_context_set_image(image);
+    imlib_image_set_has_alpha(1);
+
+    Imlib_Image premul = imlib_create_image(width, height);
+    imlib_context_set_image(premul);
+    imlib_image_set_has_alpha(1);
+    imlib_context_set_color(0, 0, 0, 255);
+    imlib_context_set_blend(0);
+    imlib_image_fill_rectangle(0, 0, width, height);
+    imlib_context_set_blend(1);
+    imlib_blend_image_onto_image(image, 0, 0, 0, width, height, 0, 0, width, height);
+    imlib_image_copy_alpha_to_image(image, 0, 0);
+
+    memcpy(pixels, imlib_image_get_data_for_reading_only(), width * height * 4);
+
+    imlib_free_image();
+    imlib_context_set_image(image);
+    imlib_free_image();
+}
+
+
+static void run(const char *name, void (*kernel)(unsigned int*, int),
+    const unsigned int *source, unsigned int *pixels, int width, int height, int iterations)
+{
+    int count = width * height;
+
+    double total = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        memcpy(pixels, source, count * 4);
+
+        double start = now();
+        if (kernel)
+            kernel(pixels, count);
+        else
+            imlibPremultiply(pixels, width, height);
+        total += now() - start;
+    }
+
+    printf("%-8s %8.3f ms/Mpix\n", name, total * 1000 / iterations / (count / 1e6));
+}
+
+
+int main(int argc, char *argv[])
+{
+    int width = argc > 1 ? atoi(argv[1]) : 800;
+    int height = argc > 2 ? atoi(argv[2]) : 480;
+    int iterations = argc > 3 ? atoi(argv[3]) : 100;
+
+    if (width < 1 || height < 1 || iterations < 1)
+    {
+        fprintf(stderr, "Usage: %s [<width> [<height> [<iterations>]]]\n", argv[0]);
+        return 1;
+    }
+
+    int count = width * height;
+    unsigned int *source = new unsigned int[count];
+    unsigned int *pixels = new unsigned int[count];
+
+    // Icons are mostly opaque or fully transparent, with soft edges
+    srand(1);
+    for (int i = 0; i < count; ++i)
+    {
+        int r = rand();
+        unsigned int alpha = r % 4 == 0 ? 0 : r % 4 == 1 ? (r >> 8) & 0xff : 0xff;
+        source[i] = alpha << 24 | (rand() & 0xffffff);
+    }
+
+    printf("%dx%d, %d iterations, premultiply() uses %s\n",
+        width, height, iterations, Premultiply::implementation());
+
+    run("imlib", 0, source, pixels, width, height, iterations);
+    run("scalar", Premultiply::scalar, source, pixels, width, height, iterations);
+#ifdef PREMULTIPLY_X86
+    if (Premultiply::haveSSE2())
+        run("sse2", Premultiply::sse2, source, pixels, width, height, iterations);
+    if (Premultiply::haveAVX2())
+        run("avx2", Premultiply::avx2, source, pixels, width, height, iterations);
+#endif
+
+    delete[] source;
+    delete[] pixels;
+
+    return 0;
+}
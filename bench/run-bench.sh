@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Telescope - graphical task switcher
+#
+# $Id$
+#
+# Measures latency from show request to the first frame on screen.
+#
+# Usage: bench/run-bench.sh [<windows>] [<iterations>] [<damage rate>]
+#
+# Starts Xvfb with synthetic client windows, runs ./telescope with
+# TELESCOPE_TRACE enabled, shows and hides it through D-Bus and prints
+# distribution of "show" -> first "synced" intervals from the trace.
+# Share files are read from /usr/share/telescope, so run "make install"
+# first.
+
+WINDOWS=${1:-30}
+ITERATIONS=${2:-50}
+DAMAGE_RATE=${3:-0}
+
+# Everything must run on private session bus
+if [ -z "$TELESCOPE_BENCH_BUS" ]; then
+    TELESCOPE_BENCH_BUS=1 exec dbus-run-session -- sh "$0" "$WINDOWS" "$ITERATIONS" "$DAMAGE_RATE"
+fi
+
+BENCH_DIR=$(dirname "$0")
+DISPLAY_NUM=${BENCH_DISPLAY:-:77}
+TRACE=$(mktemp /tmp/telescope-trace.XXXXXX)
+
+cleanup()
+{
+    kill $TELESCOPE_PID $CLIENTS_PID $XVFB_PID 2>/dev/null
+    wait 2>/dev/null
+    rm -f "$TRACE"
+}
+trap cleanup EXIT INT TERM
+
+Xvfb $DISPLAY_NUM -screen 0 1280x800x24 -nolisten tcp >/dev/null 2>&1 &
+XVFB_PID=$!
+export DISPLAY=$DISPLAY_NUM
+
+# Waiting for X server
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    xdpyinfo >/dev/null 2>&1 && break
+    sleep 0.5
+done
+
+"$BENCH_DIR/fake-clients" "$WINDOWS" "$DAMAGE_RATE" &
+CLIENTS_PID=$!
+sleep 1
+
+TELESCOPE_TRACE="$TRACE" ./telescope &
+TELESCOPE_PID=$!
+sleep 1
+
+call()
+{
+    dbus-send --session --type=method_call --dest=org.telescope \
+        /Telescope org.telescope.Telescope.$1
+}
+
+i=0
+while [ $i -lt "$ITERATIONS" ]; do
+    call Show
+    sleep 0.3
+    call Hide
+    sleep 0.2
+    i=$((i + 1))
+done
+
+sleep 0.5
+
+echo "windows=$WINDOWS iterations=$ITERATIONS damage_rate=$DAMAGE_RATE"
+awk -f "$BENCH_DIR/latency.awk" "$TRACE"
@@ -0,0 +1,147 @@
+//
+// Telescope - graphical task switcher
+//
+// (c) Ilya Skriblovsky, 2010
+// <Ilya.Skriblovsky@gmail.com>
+//
+
+// $Id$
+
+// vector-bench - compares Vector with the LinkedList it replaced
+//
+// Usage: vector-bench [<iterations>]
+//
+// Runs the operations TeleWindow and the launcher do on their window and
+// application lists (filling, walking, indexing and removing during
+// iteration) over list sizes from a handful of windows to a full menu,
+// and prints time per element. bench/LinkedList.h is the last version of
+// the list before it was removed from the tree.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "LinkedList.h"
+#include "Vector.h"
+
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// Keeps the compiler from throwing the loops away
+static volatile int sink;
+
+
+template <class List>
+static void fill(List &list, int size)
+{
+    for (int i = 0; i < size; ++i)
+        list.append(i);
+}
+
+template <class List>
+static void walk(List &list, int)
+{
+    int sum = 0;
+    for (typename List::Iter i = list.head(); i; ++i)
+        sum += *i;
+    sink = sum;
+}
+
+// Same loop over indices as layout code does
+template <class List>
+static void indexed(List &list, int)
+{
+    int sum = 0;
+    for (int i = 0; i < list.size(); ++i)
+        sum += list[i];
+    sink = sum;
+}
+
+// LinkedList iterator dangles after remove(), so step past the item first
+static void removeOdd(LinkedList<int> &list, int)
+{
+    LinkedList<int>::Iter i = list.head();
+    while (i)
+    {
+        LinkedList<int>::Iter cur = i++;
+        if (*cur & 1)
+            list.remove(cur);
+    }
+}
+
+static void removeOdd(Vector<int> &list, int)
+{
+    for (Vector<int>::Iter i = list.head(); i; ++i)
+        if (*i & 1)
+            list.remove(i);
+}
+
+
+// Times op() on a list freshly filled with size elements, the list
+// construction and filling itself is timed only when op is fill
+template <class List>
+static double measure(void (*op)(List&, int), int size, int iterations)
+{
+    double total = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        List list;
+        double start;
+        if (op == fill<List>)
+            start = now();
+        else
+        {
+            fill(list, size);
+            start = now();
+        }
+        op(list, size);
+        total += now() - start;
+    }
+
+    return total * 1e9 / iterations / size;
+}
+
+
+template <class List>
+static void run(const char *name, int size, int iterations)
+{
+    printf("%-10s %5d %10.2f %10.2f %10.2f %10.2f\n", name, size,
+        measure<List>(fill<List>, size, iterations),
+        measure<List>(walk<List>, size, iterations),
+        measure<List>(indexed<List>, size, iterations),
+        measure<List>(removeOdd, size, iterations));
+}
+
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+
+    if (iterations < 1)
+    {
+        fprintf(stderr, "Usage: %s [<iterations>]\n", argv[0]);
+        return 1;
+    }
+
+    // Few windows fit into Vector's inline storage, a busy desktop and a
+    // large menu section do not
+    static const int sizes[] = { 4, 30, 300 };
+
+    printf("%d iterations, ns per element\n", iterations);
+    printf("%-10s %5s %10s %10s %10s %10s\n", "list", "size",
+        "append", "iterate", "index", "remove");
+
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        run< LinkedList<int> >("LinkedList", sizes[i], iterations);
+        run< Vector<int> >("Vector", sizes[i], iterations);
+    }
+
+    return 0;
+}
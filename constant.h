@@ -31,6 +31,7 @@
 #define DESKTOP_FILE_PATH       "./hildon/"
 #define ICON_PATH               "./scalable/"
 #define SHARE_PATH              ""
+#define DESKTOP_CACHE           "desktop.cache"
 #else
 
 #define APPLICATION_MENU        "/home/user/.osso/menus/applications.menu"
@@ -39,6 +40,7 @@
 #define DESKTOP_FILE_PATH       "/usr/share/applications/hildon/"
 #define ICON_PATH               "/usr/share/icons/hicolor/"
 #define SHARE_PATH              "/usr/share/telescope/"
+#define DESKTOP_CACHE           "/home/user/.telescope.desktop-cache"
 
 #endif // DEV
 